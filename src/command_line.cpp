@@ -18,6 +18,8 @@
 
 #include <uuid/console.h>
 
+#include <Arduino.h>
+
 #include <string>
 #include <vector>
 
@@ -25,33 +27,58 @@ namespace uuid {
 
 namespace console {
 
-CommandLine::CommandLine(const std::string &line) {
+/*
+ * Parse a command line into separate parameters using built-in escaping
+ * rules.
+ *
+ * The current parameter is unescaped into a buffer and then copied when
+ * it is complete, so that each parameter is only allocated once. If
+ * parameters is nullptr then the parameters are only counted.
+ */
+static size_t parse_command_line(const char *line, size_t line_length, std::string &buffer,
+		std::vector<std::string> *parameters, bool &trailing_space) {
 	bool string_escape_double = false;
 	bool string_escape_single = false;
 	bool char_escape = false;
 	bool quoted_argument = false;
+	size_t count = 0;
+	size_t length = 0;
 
-	if (!line.empty()) {
-		parameters_.emplace_back(std::string{});
-	}
+	auto append = [&] (char c) {
+		if (parameters) {
+			buffer.push_back(c);
+		}
+		length++;
+	};
+
+	auto complete = [&] () {
+		if (parameters) {
+			parameters->emplace_back(buffer);
+			buffer.clear();
+		}
+		count++;
+		length = 0;
+	};
+
+	for (size_t i = 0; i < line_length; i++) {
+		char c = line[i];
 
-	for (char c : line) {
 		switch (c) {
 		case ' ':
 			if (string_escape_double || string_escape_single) {
 				if (char_escape) {
-					parameters_.back().push_back('\\');
+					append('\\');
 					char_escape = false;
 				}
-				parameters_.back().push_back(' ');
+				append(' ');
 			} else if (char_escape) {
-				parameters_.back().push_back(' ');
+				append(' ');
 				char_escape = false;
 			} else {
 				// Begin a new argument if the previous
 				// one is not empty or it was quoted
-				if (quoted_argument || !parameters_.back().empty()) {
-					parameters_.emplace_back(std::string{});
+				if (quoted_argument || length > 0) {
+					complete();
 				}
 				quoted_argument = false;
 			}
@@ -59,7 +86,7 @@ CommandLine::CommandLine(const std::string &line) {
 
 		case '"':
 			if (char_escape || string_escape_single) {
-				parameters_.back().push_back('"');
+				append('"');
 				char_escape = false;
 			} else {
 				string_escape_double = !string_escape_double;
@@ -69,7 +96,7 @@ CommandLine::CommandLine(const std::string &line) {
 
 		case '\'':
 			if (char_escape || string_escape_double) {
-				parameters_.back().push_back('\'');
+				append('\'');
 				char_escape = false;
 			} else {
 				string_escape_single = !string_escape_single;
@@ -79,7 +106,7 @@ CommandLine::CommandLine(const std::string &line) {
 
 		case '\\':
 			if (char_escape) {
-				parameters_.back().push_back('\\');
+				append('\\');
 				char_escape = false;
 			} else {
 				char_escape = true;
@@ -88,20 +115,34 @@ CommandLine::CommandLine(const std::string &line) {
 
 		default:
 			if (char_escape) {
-				parameters_.back().push_back('\\');
+				append('\\');
 				char_escape = false;
 			}
-			parameters_.back().push_back(c);
+			append(c);
 			break;
 		}
 	}
 
-	if (!parameters_.empty() && parameters_.back().empty() && !quoted_argument) {
-		parameters_.pop_back();
-		if (!parameters_.empty()) {
-			trailing_space = true;
-		}
+	if (quoted_argument || length > 0) {
+		complete();
+		trailing_space = false;
+	} else {
+		trailing_space = (count > 0);
 	}
+
+	return count;
+}
+
+CommandLine::CommandLine(const std::string &line) : CommandLine(line.c_str(), line.length()) {
+
+}
+
+CommandLine::CommandLine(const char *line, size_t length) {
+	std::string buffer;
+
+	parameters_.reserve(parse_command_line(line, length, buffer, nullptr, trailing_space));
+	buffer.reserve(length);
+	parse_command_line(line, length, buffer, &parameters_, trailing_space);
 }
 
 CommandLine::CommandLine(std::initializer_list<const std::vector<std::string>> arguments) {
@@ -110,51 +151,125 @@ CommandLine::CommandLine(std::initializer_list<const std::vector<std::string>> a
 	}
 }
 
-std::string CommandLine::to_string(size_t reserve) const {
-	std::string line;
-	size_t escape = escape_parameters_;
+//! @cond false
+/*
+ * Output buffer that only counts the length of the formatted command
+ * line.
+ */
+struct FormattedLength {
+	size_t length = 0;
 
-	line.reserve(reserve);
+	inline bool empty() const { return length == 0; }
+	inline void push_back(char c __attribute__((unused))) { length++; }
+};
 
-	for (auto &item : parameters_) {
-		if (!line.empty()) {
-			line += ' ';
+/*
+ * Characters of a parameter in a string.
+ */
+struct StringChars {
+	const std::string &text;
+	size_t position;
+
+	inline bool next(char &c) {
+		if (position == text.length()) {
+			return false;
 		}
 
-		if (item.empty()) {
-			line += '\"';
-			line += '\"';
-			goto next;
+		c = text[position++];
+		return true;
+	}
+};
+
+/*
+ * Characters of a parameter in a flash string.
+ */
+struct FlashStringChars {
+	PGM_P text;
+
+	inline bool next(char &c) {
+		c = pgm_read_byte(text);
+		if (c == '\0') {
+			return false;
 		}
 
-		for (char c : item) {
-			switch (c) {
-			case ' ':
-			case '\"':
-			case '\'':
-			case '\\':
-				if (escape > 0) {
-					line += '\\';
-				}
-				break;
-			}
+		text++;
+		return true;
+	}
+};
+//! @endcond
+
+template <class T, class Chars>
+void CommandLine::format_parameter(T &line, Chars chars, bool escape) {
+	char c;
+
+	if (!line.empty()) {
+		line.push_back(' ');
+	}
+
+	if (!chars.next(c)) {
+		line.push_back('\"');
+		line.push_back('\"');
+		return;
+	}
 
-			line += c;
+	do {
+		switch (c) {
+		case ' ':
+		case '\"':
+		case '\'':
+		case '\\':
+			if (escape) {
+				line.push_back('\\');
+			}
+			break;
 		}
 
-next:
+		line.push_back(c);
+	} while (chars.next(c));
+}
+
+template <class T>
+void CommandLine::format(T &line) const {
+	size_t escape = escape_parameters_;
+
+	for (auto &item : parameters_) {
+		format_parameter(line, StringChars{item, 0}, escape > 0);
+
 		if (escape > 0) {
 			escape--;
 		}
 	}
 
 	if (trailing_space && !line.empty()) {
-		line += ' ';
+		line.push_back(' ');
 	}
+}
+
+void CommandLine::format_flash_parameter(std::string &line, const __FlashStringHelper *parameter, bool escape) {
+	format_parameter(line, FlashStringChars{reinterpret_cast<PGM_P>(parameter)}, escape);
+}
+
+std::string CommandLine::to_string(size_t reserve) const {
+	std::string line;
 
+	line.reserve(reserve);
+	format(line);
 	return line;
 }
 
+bool CommandLine::to_string(LineBuffer &buffer) const {
+	FormattedLength formatted;
+
+	format(formatted);
+	if (formatted.length > buffer.capacity()) {
+		return false;
+	}
+
+	buffer.clear();
+	format(buffer);
+	return true;
+}
+
 void CommandLine::reset() {
 	parameters_.clear();
 	escape_all_parameters();
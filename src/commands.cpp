@@ -28,21 +28,18 @@
 #include <utility>
 #include <vector>
 
-#if !defined(__cpp_lib_make_unique) && !defined(DOXYGEN)
-namespace std {
-
-template<typename _Tp, typename... _Args>
-inline unique_ptr<_Tp> make_unique(_Args&&... __args) {
-	return unique_ptr<_Tp>(new _Tp(std::forward<_Args>(__args)...));
-}
-
-} // namespace std
-#endif
-
 namespace uuid {
 
 namespace console {
 
+FlashStringArray::FlashStringArray(const_iterator strings) : data_(strings) {
+	if (strings) {
+		while (strings[size_]) {
+			size_++;
+		}
+	}
+}
+
 void Commands::add_command(const flash_string_vector &name, command_function function) {
 	add_command(0, 0, 0, name, flash_string_vector{}, function, nullptr);
 }
@@ -104,12 +101,75 @@ void Commands::add_command(unsigned int context, unsigned int flags, unsigned in
 void Commands::add_command(unsigned int context, unsigned int flags, unsigned int not_flags,
 		const flash_string_vector &name, const flash_string_vector &arguments,
 		command_function function, argument_completion_function arg_function) {
-	commands_.emplace(std::piecewise_construct, std::forward_as_tuple(context),
-			std::forward_as_tuple(flags, not_flags, name, arguments, function, arg_function));
+	insert_command(context, Command{flags, not_flags, name, arguments, function, arg_function});
+}
+
+void Commands::add_command(unsigned int context, unsigned int flags, unsigned int not_flags,
+		const flash_string_vector &name, const flash_string_vector &arguments,
+		command_function function, argument_completion_stream_function arg_function) {
+	Command command{flags, not_flags, name, arguments, function, nullptr};
+
+	command.arg_stream_function_ = arg_function;
+	insert_command(context, std::move(command));
+}
+
+void Commands::add_command(unsigned int context, unsigned int flags, unsigned int not_flags,
+		const flash_string_vector &name, const flash_string_vector &arguments,
+		command_function function, std::nullptr_t arg_function __attribute__((unused))) {
+	add_command(context, flags, not_flags, name, arguments, function, argument_completion_function{});
+}
+
+void Commands::add_commands(const StaticCommand *commands, size_t count) {
+	if (!executing_) {
+		commands_.reserve(commands_.size() + count);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		insert_command(commands[i].context, Command{commands[i]});
+	}
+}
+
+void Commands::insert_command(unsigned int context, Command &&command) {
+	if (executing_) {
+		// Existing commands must not move while they're being executed
+		pending_commands_.emplace_back(context, std::move(command));
+		return;
+	}
+
+	revision_++;
+
+	// Commands in the same context are kept in the order they were added
+	auto position = std::upper_bound(commands_.cbegin(), commands_.cend(), context,
+		[] (unsigned int value, const std::pair<unsigned int,Command> &entry) {
+			return value < entry.first;
+		});
+
+	commands_.emplace(position, context, std::move(command));
+
+	if (indexed_) {
+		index_.clear();
+		indexed_ = false;
+	}
+}
+
+void Commands::insert_pending_commands() {
+	std::vector<std::pair<unsigned int,Command>> pending;
+
+	std::swap(pending, pending_commands_);
+
+	for (auto &entry : pending) {
+		insert_command(entry.first, std::move(entry.second));
+	}
 }
 
 Commands::Execution Commands::execute_command(Shell &shell, CommandLine &&command_line) {
+#if UUID_CONSOLE_STATISTICS
+	unsigned long start_us = ::micros();
+#endif
 	auto commands = find_command(shell, command_line);
+#if UUID_CONSOLE_STATISTICS
+	shell.statistics_.find_command_time += ::micros() - start_us;
+#endif
 	auto longest = commands.exact.crbegin();
 	Execution result;
 
@@ -121,6 +181,7 @@ Commands::Execution Commands::execute_command(Shell &shell, CommandLine &&comman
 		auto &command = longest->second;
 		std::vector<std::string> arguments;
 
+		arguments.reserve(command_line->size() - command->name_.size());
 		for (auto it = std::next(command_line->cbegin(), command->name_.size()); it != command_line->cend(); it++) {
 			arguments.push_back(std::move(*it));
 		}
@@ -133,7 +194,19 @@ Commands::Execution Commands::execute_command(Shell &shell, CommandLine &&comman
 		} else if (arguments.size() > command->maximum_arguments()) {
 			result.error = F("Too many arguments for command");
 		} else {
+#if UUID_CONSOLE_STATISTICS
+			start_us = ::micros();
+#endif
+			executing_++;
 			command->function_(shell, arguments);
+#if UUID_CONSOLE_STATISTICS
+			command->executions_.add(1);
+			command->execution_time_.add(::micros() - start_us);
+#endif
+
+			if (--executing_ == 0 && !pending_commands_.empty()) {
+				insert_pending_commands();
+			}
 		}
 	} else {
 		result.error = F("Fatal error (multiple commands found)");
@@ -142,7 +215,7 @@ Commands::Execution Commands::execute_command(Shell &shell, CommandLine &&comman
 	return result;
 }
 
-bool Commands::find_longest_common_prefix(const std::multimap<size_t,const Command*> &commands, std::vector<std::string> &longest_name) {
+bool Commands::find_longest_common_prefix(const Match::command_map &commands, std::vector<std::string> &longest_name) {
 	size_t component_prefix = 0;
 	size_t shortest_match = commands.begin()->first;
 
@@ -155,7 +228,7 @@ bool Commands::find_longest_common_prefix(const std::multimap<size_t,const Comma
 
 		for (size_t length = 0; all_match && length < shortest_match; length++) {
 			for (auto command_it = std::next(commands.begin()); command_it != commands.end(); command_it++) {
-				if (read_flash_string(*std::next(first.begin(), length)) != read_flash_string(*std::next(command_it->second->name_.begin(), length))) {
+				if (!flash_string_equal(*std::next(first.begin(), length), *std::next(command_it->second->name_.begin(), length))) {
 					all_match = false;
 					break;
 				}
@@ -204,33 +277,126 @@ bool Commands::find_longest_common_prefix(const std::multimap<size_t,const Comma
 	return true;
 }
 
-std::string Commands::find_longest_common_prefix(const std::vector<std::string> &arguments) {
-	auto& first = *arguments.begin();
-	bool all_match = true;
-	size_t chars_prefix = 0;
+bool Commands::flash_string_equal(const __FlashStringHelper *str, const std::string &text) {
+	PGM_P str_ptr = reinterpret_cast<PGM_P>(str);
 
-	for (size_t length = 0; all_match; length++) {
-		for (auto argument_it = std::next(arguments.begin()); argument_it != arguments.end(); argument_it++) {
-			// This relies on the null terminator character limiting the
-			// length before it becomes longer than any of the strings
-			if (first[length] != (*argument_it)[length]) {
-				all_match = false;
-				break;
-			}
+	for (size_t i = 0; i < text.length(); i++) {
+		char c = pgm_read_byte(str_ptr + i);
+
+		if (c == '\0' || c != text[i]) {
+			return false;
+		}
+	}
+
+	return pgm_read_byte(str_ptr + text.length()) == '\0';
+}
+
+bool Commands::flash_string_equal(const __FlashStringHelper *str1, const __FlashStringHelper *str2) {
+	if (str1 == str2) {
+		return true;
+	}
+
+	PGM_P str1_ptr = reinterpret_cast<PGM_P>(str1);
+	PGM_P str2_ptr = reinterpret_cast<PGM_P>(str2);
+
+	while (true) {
+		char c = pgm_read_byte(str1_ptr++);
+
+		if (c != pgm_read_byte(str2_ptr++)) {
+			return false;
+		} else if (c == '\0') {
+			return true;
+		}
+	}
+}
+
+bool Commands::flash_string_starts_with(const __FlashStringHelper *str, const std::string &prefix) {
+	PGM_P str_ptr = reinterpret_cast<PGM_P>(str);
+
+	for (size_t i = 0; i < prefix.length(); i++) {
+		char c = pgm_read_byte(str_ptr + i);
+
+		if (c == '\0' || c != prefix[i]) {
+			return false;
 		}
+	}
+
+	return true;
+}
+
+Commands::ArgumentCompletions::ArgumentCompletions(const std::string &next_argument, size_t limit)
+		: next_argument_(next_argument), limit_(limit) {
+
+}
+
+bool Commands::ArgumentCompletions::add(std::string value) {
+	if (value.rfind(next_argument_, 0) != 0) {
+		return true;
+	}
+
+	if (count_ == 0) {
+		common_prefix_ = value;
+	} else {
+		size_t length = 0;
 
-		if (all_match) {
-			chars_prefix = length + 1;
+		while (length < common_prefix_.length() && length < value.length()
+				&& common_prefix_[length] == value[length]) {
+			length++;
 		}
+
+		common_prefix_.resize(length);
+	}
+
+	count_++;
+
+	if (limit_ == 0 || values_.size() < limit_) {
+		values_.push_back(std::move(value));
 	}
 
-	return arguments.begin()->substr(0, chars_prefix);
+	if (limit_ != 0 && values_.size() == limit_ && count_ > 1
+			&& common_prefix_.length() == next_argument_.length()) {
+		// More values can't be shown and can't shorten the common prefix
+		complete_ = false;
+		return false;
+	}
+
+	return true;
 }
 
 Commands::Completion Commands::complete_command(Shell &shell, const CommandLine &command_line) {
-	auto commands = find_command(shell, command_line);
+	return complete_command(shell, command_line, nullptr);
+}
+
+Commands::Completion Commands::complete_command(Shell &shell, const CommandLine &command_line, CompletionCache *cache) {
+#if UUID_CONSOLE_STATISTICS
+	unsigned long start_us = ::micros();
+	auto result = complete_matching_command(shell, command_line, cache);
+
+	shell.statistics_.complete_command_time += ::micros() - start_us;
+	return result;
+#else
+	return complete_matching_command(shell, command_line, cache);
+#endif
+}
+
+Commands::Completion Commands::complete_matching_command(Shell &shell, const CommandLine &command_line, CompletionCache *cache) {
+	if (cache && cache->revision != revision_) {
+		// The commands that the cache refers to may no longer exist
+		*cache = CompletionCache{};
+		cache->revision = revision_;
+	}
+
+	auto commands = (cache && extends_command_line(cache->parameters, cache->trailing_space, command_line))
+		? find_command(shell, command_line, cache->commands)
+		: find_command(shell, command_line);
 	Completion result;
 
+	if (cache) {
+		cache->parameters.assign(command_line->cbegin(), command_line->cend());
+		cache->trailing_space = command_line.trailing_space;
+		cache->commands.assign(commands.all.cbegin(), commands.all.cend());
+	}
+
 	auto match = commands.partial.begin();
 	size_t count;
 	bool multiple_matches;
@@ -247,17 +413,16 @@ Commands::Completion Commands::complete_command(Shell &shell, const CommandLine
 		return result;
 	}
 
-	std::unique_ptr<Command> temp_command;
+	bool temp_command = false;
 	std::vector<std::string> temp_command_name;
-	std::multimap<size_t,const Command*>::iterator temp_command_it;
 
 	if (multiple_matches && (commands.exact.empty() || command_line.total_size() > commands.exact.begin()->second->name_.size())) {
 		// There are multiple matching commands, find the longest common prefix
 		bool whole_components = find_longest_common_prefix(commands.partial, temp_command_name);
 
-		// Construct a temporary command with the longest common prefix to use as the replacement
+		// Use a temporary command name with the longest common prefix as the replacement
 		if (!temp_command_name.empty() && command_line.total_size() <= temp_command_name.size()) {
-			temp_command = std::make_unique<Command>(0, 0, flash_string_vector{}, flash_string_vector{}, nullptr, nullptr);
+			temp_command = true;
 			count = 1;
 			match = commands.partial.end();
 			result.replacement.trailing_space = whole_components;
@@ -296,39 +461,58 @@ Commands::Completion Commands::complete_command(Shell &shell, const CommandLine
 				}
 			}
 
-			auto potential_arguments = matching_command->arg_function_
-					? matching_command->arg_function_(shell, arguments, last_argument)
-							: std::vector<std::string>{};
+			ArgumentCompletions potential_arguments{last_argument, shell.maximum_argument_completions()};
 
-			// Remove arguments that can't match
-			if (!command_line.trailing_space) {
-				for (auto it = potential_arguments.begin(); it != potential_arguments.end(); ) {
-					if (it->rfind(last_argument, 0) == std::string::npos) {
-						it = potential_arguments.erase(it);
-					} else {
-						it++;
+			if (cache && cache->argument_command == matching_command
+					&& cache->arguments == arguments
+					&& last_argument.rfind(cache->next_argument, 0) == 0) {
+				// This argument extends the previous argument so it can only match fewer values
+				for (auto &value : cache->potential_arguments) {
+					if (!potential_arguments.add(value)) {
+						break;
+					}
+				}
+			} else if (matching_command->arg_stream_function_) {
+				matching_command->arg_stream_function_(shell, arguments, last_argument, potential_arguments);
+			} else if (matching_command->arg_function_) {
+				for (auto &value : matching_command->arg_function_(shell, arguments, last_argument)) {
+					if (!potential_arguments.add(value)) {
+						break;
 					}
 				}
 			}
 
+			if (cache) {
+				if (potential_arguments.complete()) {
+					cache->argument_command = matching_command;
+					cache->arguments = arguments;
+					cache->next_argument = last_argument;
+					cache->potential_arguments = potential_arguments.values();
+				} else {
+					cache->argument_command = nullptr;
+				}
+			}
+
 			// Auto-complete if there's something present in the last argument
 			// or the only potential argument is an empty string.
 			if (!command_line.trailing_space) {
-				if (potential_arguments.size() == 1) {
-					if (last_argument == *potential_arguments.begin()) {
+				if (potential_arguments.count() == 1) {
+					auto &value = potential_arguments.values().front();
+
+					if (last_argument == value) {
 						if (result.replacement->size() + 1 < matching_command->name_.size() + matching_command->maximum_arguments()) {
 							// Add a space because this argument is complete and there are more arguments for this command
 							result.replacement.trailing_space = true;
 						}
 					}
 
-					last_argument = *potential_arguments.begin();
-					potential_arguments.clear();
+					last_argument = std::move(value);
+					potential_arguments.values().clear();
 
 					// Remaining help should skip the replaced argument
 					current_args_count++;
-				} else if (potential_arguments.size() > 1) {
-					last_argument = find_longest_common_prefix(potential_arguments);
+				} else if (potential_arguments.count() > 1) {
+					last_argument = potential_arguments.common_prefix();
 				}
 			}
 
@@ -339,7 +523,7 @@ Commands::Completion Commands::complete_command(Shell &shell, const CommandLine
 
 			CommandLine remaining_help;
 
-			if (!potential_arguments.empty()) {
+			if (!potential_arguments.values().empty()) {
 				// Remaining help should skip the suggested argument
 				current_args_count++;
 			}
@@ -352,15 +536,15 @@ Commands::Completion Commands::complete_command(Shell &shell, const CommandLine
 				}
 			}
 
-			if (potential_arguments.empty()) {
+			if (potential_arguments.values().empty()) {
 				if (!remaining_help->empty()) {
 					result.help.push_back(std::move(remaining_help));
 				}
 			} else {
-				for (auto potential_argument : potential_arguments) {
+				for (auto &potential_argument : potential_arguments.values()) {
 					CommandLine help;
 
-					help->emplace_back(potential_argument);
+					help->push_back(std::move(potential_argument));
 
 					if (!remaining_help->empty()) {
 						help.escape_initial_parameters();
@@ -401,18 +585,16 @@ Commands::Completion Commands::complete_command(Shell &shell, const CommandLine
 			}
 
 			for (; flash_name_it != (*command_it)->name_.cend(); flash_name_it++) {
-				std::string name = read_flash_string(*flash_name_it);
-
 				// Skip parts of the command name that match the command line
 				if (line_it != command_line->cend()) {
-					if (name == *line_it++) {
+					if (flash_string_equal(*flash_name_it, *line_it++)) {
 						continue;
 					} else {
 						line_it = command_line->cend();
 					}
 				}
 
-				help->emplace_back(name);
+				help->push_back(std::move(read_flash_string(*flash_name_it)));
 			}
 
 			help.escape_initial_parameters();
@@ -454,71 +636,163 @@ Commands::Completion Commands::complete_command(Shell &shell, const CommandLine
 }
 
 Commands::Match Commands::find_command(Shell &shell, const CommandLine &command_line) {
-	Match commands;
-	auto context_commands = commands_.equal_range(shell.context());
+	if (indexed_) {
+		auto index = index_.find(shell.context());
+
+		if (index != index_.end()) {
+			return find_indexed_command(shell, index->second, command_line);
+		} else {
+			return Match{&shell.scratch_arena()};
+		}
+	}
 
-	for (auto it = context_commands.first; it != context_commands.second; it++) {
+	Match commands{&shell.scratch_arena()};
+	auto range = context_commands(shell.context());
+
+	for (auto it = range.first; it != range.second; it++) {
 		auto& command = it->second;
-		bool match = true;
-		bool exact = true;
 
-		if (!shell.has_flags(command.flags_, command.not_flags_)) {
-			continue;
+		if (shell.has_flags(command.flags_, command.not_flags_)) {
+			match_command(commands, command, command_line);
 		}
+	}
+
+	return commands;
+}
 
-		auto name_it = command.name_.cbegin();
-		auto line_it = command_line->cbegin();
+Commands::Match Commands::find_command(Shell &shell, const CommandLine &command_line, const std::vector<const Command*> &candidates) {
+	Match commands{&shell.scratch_arena()};
 
-		for (; name_it != command.name_.cend() && line_it != command_line->cend(); name_it++, line_it++) {
-			std::string name = read_flash_string(*name_it);
-			size_t found = name.rfind(*line_it, 0);
+	for (auto command : candidates) {
+		match_command(commands, *command, command_line);
+	}
 
-			if (found == std::string::npos) {
-				match = false;
-				break;
-			} else if (line_it->length() != name.length()) {
-				for (auto line_check_it = std::next(line_it); line_check_it != command_line->cend(); line_check_it++) {
-					if (!line_check_it->empty()) {
-						// If there's more in the command line then this can't match
-						match = false;
-					}
-				}
+	return commands;
+}
+
+void Commands::match_command(Match &commands, const Command &command, const CommandLine &command_line) {
+	bool match = true;
+	bool exact = true;
 
-				if (command_line.trailing_space) {
-					// If there's a trailing space in the command line then this can't be a partial match
+	auto name_it = command.name_.cbegin();
+	auto line_it = command_line->cbegin();
+
+	for (; name_it != command.name_.cend() && line_it != command_line->cend(); name_it++, line_it++) {
+		if (flash_string_equal(*name_it, *line_it)) {
+			continue;
+		} else if (!flash_string_starts_with(*name_it, *line_it)) {
+			match = false;
+			break;
+		} else {
+			for (auto line_check_it = std::next(line_it); line_check_it != command_line->cend(); line_check_it++) {
+				if (!line_check_it->empty()) {
+					// If there's more in the command line then this can't match
 					match = false;
 				}
+			}
 
-				// Don't check the rest of the command if this is only a partial match
-				break;
+			if (command_line.trailing_space) {
+				// If there's a trailing space in the command line then this can't be a partial match
+				match = false;
 			}
+
+			// Don't check the rest of the command if this is only a partial match
+			break;
 		}
+	}
 
-		if (name_it != command.name_.cend()) {
-			exact = false;
+	if (name_it != command.name_.cend()) {
+		exact = false;
+	}
+
+	if (match) {
+		if (exact) {
+			commands.exact.emplace(command.name_.size(), &command);
+		} else {
+			commands.partial.emplace(command.name_.size(), &command);
 		}
+		commands.all.push_back(&command);
+	}
+}
 
-		if (match) {
-			if (exact) {
-				commands.exact.emplace(command.name_.size(), &command);
-			} else {
-				commands.partial.emplace(command.name_.size(), &command);
-			}
-			commands.all.push_back(&command);
+bool Commands::extends_command_line(const std::vector<std::string> &previous, bool previous_trailing_space, const CommandLine &current) {
+	if (previous.empty() || current->size() < previous.size()) {
+		return false;
+	}
+
+	size_t last = previous.size() - 1;
+
+	for (size_t i = 0; i < last; i++) {
+		if (previous[i] != (*current)[i]) {
+			return false;
 		}
 	}
 
-	return commands;
+	if (previous_trailing_space) {
+		if ((*current)[last] != previous[last]) {
+			return false;
+		}
+
+		if (current->size() == previous.size() && !current.trailing_space) {
+			return false;
+		}
+	} else if ((*current)[last].rfind(previous[last], 0) != 0) {
+		return false;
+	}
+
+	for (size_t i = last; i < current->size(); i++) {
+		// An empty parameter could allow a partial match that didn't match before
+		if ((*current)[i].empty()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Commands::compact() {
+	if (executing_) {
+		return;
+	}
+
+	commands_.shrink_to_fit();
+}
+
+std::pair<Commands::AvailableCommands::command_iterator,Commands::AvailableCommands::command_iterator>
+		Commands::context_commands(unsigned int context) const {
+	auto begin = std::lower_bound(commands_.cbegin(), commands_.cend(), context,
+		[] (const std::pair<unsigned int,Command> &entry, unsigned int value) {
+			return entry.first < value;
+		});
+	auto end = std::upper_bound(begin, commands_.cend(), context,
+		[] (unsigned int value, const std::pair<unsigned int,Command> &entry) {
+			return value < entry.first;
+		});
+
+	return {begin, end};
 }
 
 Commands::Command::Command(unsigned int flags, unsigned int not_flags,
 		const flash_string_vector name, const flash_string_vector arguments,
 		command_function function, argument_completion_function arg_function)
-		: flags_(flags), not_flags_(not_flags), name_(name), arguments_(arguments),
+		: flags_(flags), not_flags_(not_flags), name_vector_(name), arguments_vector_(arguments),
+		  name_(name_vector_), arguments_(arguments_vector_),
 		  function_(function), arg_function_(arg_function) {
 
 }
 
+Commands::Command::Command(const StaticCommand &command)
+		: flags_(command.flags), not_flags_(command.not_flags),
+		  name_(command.name), arguments_(command.arguments) {
+	if (command.function) {
+		function_ = command.function;
+	}
+
+	if (command.arg_function) {
+		arg_function_ = command.arg_function;
+	}
+}
+
 Commands::Command::~Command() {
 
 }
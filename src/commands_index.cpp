@@ -0,0 +1,165 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <uuid/console.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace uuid {
+
+namespace console {
+
+void Commands::build_index() {
+	index_.clear();
+
+	for (auto &entry : commands_) {
+		auto &index = index_[entry.first];
+		auto &command = entry.second;
+		size_t node = 0;
+
+		if (index.nodes.empty()) {
+			index.nodes.push_back(IndexNode{nullptr, command.flags_, command.not_flags_, {}, {}});
+		} else {
+			index.nodes[node].flags &= command.flags_;
+			index.nodes[node].not_flags &= command.not_flags_;
+		}
+
+		for (auto name : command.name_) {
+			auto &children = index.nodes[node].children;
+			auto child = std::find_if(children.cbegin(), children.cend(),
+				[&index, name] (size_t position) {
+					return flash_string_equal(index.nodes[position].name, name);
+				});
+
+			if (child != children.cend()) {
+				node = *child;
+				index.nodes[node].flags &= command.flags_;
+				index.nodes[node].not_flags &= command.not_flags_;
+			} else {
+				size_t position = index.nodes.size();
+
+				children.push_back(position);
+				// This may move the node that children refers to
+				index.nodes.push_back(IndexNode{name, command.flags_, command.not_flags_, {}, {}});
+				node = position;
+			}
+		}
+
+		index.nodes[node].commands.push_back(index.commands.size());
+		index.commands.push_back(&command);
+	}
+
+	indexed_ = true;
+}
+
+Commands::Match Commands::find_indexed_command(Shell &shell, const Index &index, const CommandLine &command_line) {
+	IndexMatches found{IndexMatches::allocator_type{&shell.scratch_arena()}};
+	Match commands{&shell.scratch_arena()};
+
+	find_indexed_command(shell, index, 0, 0, command_line, found);
+
+	// Report matching commands in defined order
+	std::sort(found.begin(), found.end());
+
+	commands.all.reserve(found.size());
+	for (auto &match : found) {
+		auto command = index.commands[match.first];
+
+		if (match.second) {
+			commands.exact.emplace(command->name_.size(), command);
+		} else {
+			commands.partial.emplace(command->name_.size(), command);
+		}
+		commands.all.push_back(command);
+	}
+
+	return commands;
+}
+
+void Commands::find_indexed_command(Shell &shell, const Index &index, size_t node, size_t depth,
+		const CommandLine &command_line, IndexMatches &found) {
+	auto &current = index.nodes[node];
+
+	if (!shell.has_flags(current.flags, current.not_flags)) {
+		return;
+	}
+
+	for (auto position : current.commands) {
+		auto command = index.commands[position];
+
+		if (shell.has_flags(command->flags_, command->not_flags_)) {
+			found.emplace_back(position, true);
+		}
+	}
+
+	if (depth == command_line->size()) {
+		// Every longer command is a partial match
+		for (auto child : current.children) {
+			find_indexed_partial_commands(shell, index, child, found);
+		}
+		return;
+	}
+
+	auto line_it = std::next(command_line->cbegin(), depth);
+	bool partial = !command_line.trailing_space;
+
+	// If there's more in the command line then this can't be a partial match
+	for (auto line_check_it = std::next(line_it); partial && line_check_it != command_line->cend(); line_check_it++) {
+		if (!line_check_it->empty()) {
+			partial = false;
+		}
+	}
+
+	for (auto child : current.children) {
+		auto name = index.nodes[child].name;
+
+		if (flash_string_equal(name, *line_it)) {
+			find_indexed_command(shell, index, child, depth + 1, command_line, found);
+		} else if (partial && flash_string_starts_with(name, *line_it)) {
+			find_indexed_partial_commands(shell, index, child, found);
+		}
+	}
+}
+
+void Commands::find_indexed_partial_commands(Shell &shell, const Index &index, size_t node,
+		IndexMatches &found) {
+	auto &current = index.nodes[node];
+
+	if (!shell.has_flags(current.flags, current.not_flags)) {
+		return;
+	}
+
+	for (auto position : current.commands) {
+		auto command = index.commands[position];
+
+		if (shell.has_flags(command->flags_, command->not_flags_)) {
+			found.emplace_back(position, false);
+		}
+	}
+
+	for (auto child : current.children) {
+		find_indexed_partial_commands(shell, index, child, found);
+	}
+}
+
+} // namespace console
+
+} // namespace uuid
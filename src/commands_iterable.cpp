@@ -26,20 +26,34 @@ namespace uuid {
 namespace console {
 
 Commands::AvailableCommands Commands::available_commands(const Shell &shell) const {
-	auto range = commands_.equal_range(shell.context());
+	auto range = context_commands(shell.context());
 	return AvailableCommands(shell, range.first, range.second);
 }
 
-Commands::AvailableCommand::AvailableCommand(const Command &command) : command_(command) {
-	name_.reserve(command_.name_.size());
-	for (auto flash_name : command_.name_) {
-		name_.push_back(std::move(read_flash_string(flash_name)));
+Commands::AvailableCommand::AvailableCommand(const Command &command) : command_(&command) {
+
+}
+
+const std::vector<std::string> &Commands::AvailableCommand::name() const {
+	if (name_.size() != command_->name_.size()) {
+		name_.reserve(command_->name_.size());
+		for (auto flash_name : command_->name_) {
+			name_.push_back(std::move(read_flash_string(flash_name)));
+		}
 	}
 
-	arguments_.reserve(command_.arguments_.size());
-	for (auto flash_argument : command_.arguments_) {
-		arguments_.push_back(std::move(read_flash_string(flash_argument)));
+	return name_;
+}
+
+const std::vector<std::string> &Commands::AvailableCommand::arguments() const {
+	if (arguments_.size() != command_->arguments_.size()) {
+		arguments_.reserve(command_->arguments_.size());
+		for (auto flash_argument : command_->arguments_) {
+			arguments_.push_back(std::move(read_flash_string(flash_argument)));
+		}
 	}
+
+	return arguments_;
 }
 
 Commands::AvailableCommands::AvailableCommands(const Shell &shell,
@@ -68,9 +82,9 @@ Commands::AvailableCommands::const_iterator::const_iterator(const Shell &shell,
 
 void Commands::AvailableCommands::const_iterator::update() {
 	if (command_ != end_) {
-		available_command_ = std::make_shared<AvailableCommand>(command_->second);
+		available_command_ = AvailableCommand{command_->second};
 	} else {
-		available_command_.reset();
+		available_command_ = AvailableCommand{};
 	}
 }
 
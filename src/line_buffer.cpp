@@ -0,0 +1,103 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <uuid/console.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace uuid {
+
+namespace console {
+
+#if UUID_CONSOLE_LINE_BUFFER_SIZE > 0
+void LineBuffer::capacity(size_t capacity) {
+	capacity_ = std::min(capacity, (size_t)UUID_CONSOLE_LINE_BUFFER_SIZE);
+	resize(capacity_);
+}
+#else
+void LineBuffer::capacity(size_t capacity) {
+	if (capacity == capacity_) {
+		return;
+	}
+
+	std::unique_ptr<char[]> data{new char[capacity + 1]};
+
+	length_ = std::min(length_, capacity);
+	if (length_ > 0) {
+		std::memcpy(&data[0], &data_[0], length_);
+	}
+	data[length_] = '\0';
+
+	data_ = std::move(data);
+	capacity_ = capacity;
+}
+#endif
+
+bool LineBuffer::push_back(char c) {
+	if (length_ >= capacity_) {
+		return false;
+	}
+
+	data_[length_++] = c;
+	data_[length_] = '\0';
+	return true;
+}
+
+void LineBuffer::pop_back() {
+	if (length_ > 0) {
+		data_[--length_] = '\0';
+	}
+}
+
+void LineBuffer::clear() {
+	resize(0);
+}
+
+void LineBuffer::resize(size_t length) {
+	if (length < length_) {
+		length_ = length;
+		data_[length_] = '\0';
+	}
+}
+
+void LineBuffer::assign(const char *text, size_t length) {
+	if (capacity_ == 0) {
+		return;
+	}
+
+	length_ = std::min(length, capacity_);
+	std::memcpy(&data_[0], text, length_);
+	data_[length_] = '\0';
+}
+
+size_t LineBuffer::find_last_of(char c) const {
+	for (size_t i = length_; i > 0; i--) {
+		if (data_[i - 1] == c) {
+			return i - 1;
+		}
+	}
+
+	return std::string::npos;
+}
+
+} // namespace console
+
+} // namespace uuid
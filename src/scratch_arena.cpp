@@ -0,0 +1,82 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <uuid/console.h>
+
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace uuid {
+
+namespace console {
+
+size_t ScratchArena::size() const {
+	return requested_size_;
+}
+
+void ScratchArena::size(size_t size) {
+	requested_size_ = size;
+
+	if (allocations_ == 0) {
+		if (requested_size_ != size_) {
+			block_.reset(requested_size_ > 0 ? new uint8_t[requested_size_] : nullptr);
+			size_ = requested_size_;
+		}
+		used_ = 0;
+	}
+}
+
+void *ScratchArena::allocate(size_t size, size_t align) {
+	if (allocations_ == 0 && requested_size_ != size_) {
+		this->size(requested_size_);
+	}
+
+	// Alignment is always a power of 2
+	size_t offset = (used_ + align - 1) & ~(align - 1);
+
+	if (size > 0 && offset <= size_ && size <= size_ - offset) {
+		used_ = offset + size;
+		allocations_++;
+		return &block_[offset];
+	}
+
+	return ::operator new(size);
+}
+
+void ScratchArena::deallocate(void *ptr, size_t size) {
+	uint8_t *data = static_cast<uint8_t*>(ptr);
+
+	if (size_ > 0 && data >= block_.get() && data < block_.get() + size_) {
+		if (data + size == block_.get() + used_) {
+			// This was the most recent allocation
+			used_ = data - block_.get();
+		}
+
+		allocations_--;
+		if (allocations_ == 0) {
+			used_ = 0;
+		}
+	} else {
+		::operator delete(ptr);
+	}
+}
+
+} // namespace console
+
+} // namespace uuid
@@ -51,14 +51,31 @@ Shell::Shell(Stream &stream, std::shared_ptr<Commands> commands, unsigned int co
 	enter_context(context);
 }
 
+Shell::~Shell() {
+	unschedule_timer();
+}
+
 void Shell::start() {
-	uuid::log::Logger::register_handler(this, uuid::log::Level::NOTICE);
-	line_buffer_.reserve(maximum_command_line_length_);
+	start(default_group());
+}
+
+void Shell::start(Group &group) {
+	started_ = true;
+
+	if (!shared_log_queue_) {
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+		log_handler_registered_ = true;
+#endif
+		uuid::log::Logger::register_handler(this, uuid::log::Level::NOTICE);
+	}
+	line_buffer_.capacity(maximum_command_line_length_);
+	maximum_command_line_length_ = line_buffer_.capacity();
 	display_banner();
 	display_prompt();
-	registered_shells().insert(shared_from_this());
 	idle_time_ = uuid::get_uptime_ms();
 	started();
+	flush();
+	group.add(shared_from_this());
 };
 
 void Shell::started() {
@@ -78,6 +95,7 @@ void Shell::stop() {
 		if (running()) {
 			stopped_ = true;
 			stopped();
+			flush();
 		}
 	}
 }
@@ -89,6 +107,8 @@ void Shell::stopped() {
 bool Shell::exit_context() {
 	if (context_.size() > 1) {
 		context_.pop_back();
+		clear_completion_cache();
+		invalidate_prompt();
 		return true;
 	} else {
 		return false;
@@ -124,96 +144,118 @@ void Shell::loop_one() {
 		loop_blocking();
 		break;
 	}
+
+	flush();
 }
 
 void Shell::loop_normal() {
-	const int input = stream_.read();
-
-	if (input < 0) {
-		check_idle_timeout();
-		return;
-	}
+	size_t count = 0;
 
-	const unsigned char c = input;
+	while (count < maximum_input_batch_) {
+		const int input = stream_.read();
 
-	switch (c) {
-	case '\x03':
-		// Interrupt (^C)
-		line_buffer_.clear();
-		println();
-		prompt_displayed_ = false;
-		display_prompt();
-		break;
-
-	case '\x04':
-		// End of transmission (^D)
-		if (line_buffer_.empty()) {
-			end_of_transmission();
+		if (input < 0) {
+			break;
 		}
-		break;
 
-	case '\x08':
-	case '\x7F':
-		// Backspace (^H)
-		// Delete (^?)
-		if (!line_buffer_.empty()) {
-			erase_characters(1);
-			line_buffer_.pop_back();
-		}
-		break;
+		const unsigned char c = input;
+		bool line_complete = false;
 
-	case '\x09':
-		// Tab (^I)
-		process_completion();
-		break;
+		count++;
 
-	case '\x0A':
-		// Line feed (^J)
-		if (previous_ != '\x0D') {
-			process_command();
-		}
-		break;
+		switch (c) {
+		case '\x03':
+			// Interrupt (^C)
+			line_buffer_.clear();
+			println();
+			prompt_displayed_ = false;
+			display_prompt();
+			line_complete = true;
+			break;
+
+		case '\x04':
+			// End of transmission (^D)
+			if (line_buffer_.empty()) {
+				end_of_transmission();
+				line_complete = true;
+			}
+			break;
+
+		case '\x08':
+		case '\x7F':
+			// Backspace (^H)
+			// Delete (^?)
+			if (!line_buffer_.empty()) {
+				erase_characters(1);
+				line_buffer_.pop_back();
+			}
+			break;
+
+		case '\x09':
+			// Tab (^I)
+			process_completion();
+			break;
+
+		case '\x0A':
+			// Line feed (^J)
+			if (previous_ != '\x0D') {
+				process_command();
+				line_complete = true;
+			}
+			break;
 
-	case '\x0C':
-		// New page (^L)
-		erase_current_line();
-		prompt_displayed_ = false;
-		display_prompt();
-		break;
+		case '\x0C':
+			// New page (^L)
+			erase_current_line();
+			prompt_displayed_ = false;
+			display_prompt();
+			break;
 
-	case '\x0D':
-		// Carriage return (^M)
-		process_command();
-		break;
+		case '\x0D':
+			// Carriage return (^M)
+			process_command();
+			line_complete = true;
+			break;
 
-	case '\x15':
-		// Delete line (^U)
-		erase_current_line();
-		prompt_displayed_ = false;
-		line_buffer_.clear();
-		display_prompt();
-		break;
+		case '\x15':
+			// Delete line (^U)
+			erase_current_line();
+			prompt_displayed_ = false;
+			line_buffer_.clear();
+			display_prompt();
+			break;
+
+		case '\x17':
+			// Delete word (^W)
+			delete_buffer_word(true);
+			break;
+
+		default:
+			if (c >= '\x20' && c <= '\x7E') {
+				// ASCII text
+				if (line_buffer_.push_back(c)) {
+					write((uint8_t)c);
+				}
+			}
+			break;
+		}
 
-	case '\x17':
-		// Delete word (^W)
-		delete_buffer_word(true);
-		break;
+		previous_ = c;
 
-	default:
-		if (c >= '\x20' && c <= '\x7E') {
-			// ASCII text
-			if (line_buffer_.length() < maximum_command_line_length_) {
-				line_buffer_.push_back(c);
-				write((uint8_t)c);
-			}
+		// Any remaining input belongs to the next command or mode
+		if (line_complete || mode_ != Mode::NORMAL || !running()) {
+			break;
 		}
-		break;
 	}
 
-	previous_ = c;
+	if (count == 0) {
+		check_idle_timeout();
+		return;
+	}
 
 	// This is a hack to let TelnetStream know that command
 	// execution is complete and that output can be flushed.
+	flush();
 	stream_.available();
 
 	idle_time_ = uuid::get_uptime_ms();
@@ -225,73 +267,87 @@ Shell::PasswordData::PasswordData(const __FlashStringHelper *password_prompt, pa
 }
 
 void Shell::loop_password() {
-	const int input = stream_.read();
+	size_t count = 0;
 
-	if (input < 0) {
-		check_idle_timeout();
-		return;
-	}
+	while (count < maximum_input_batch_) {
+		const int input = stream_.read();
 
-	const unsigned char c = input;
+		if (input < 0) {
+			break;
+		}
 
-	switch (c) {
-	case '\x03':
-		// Interrupt (^C)
-		process_password(false);
-		break;
+		const unsigned char c = input;
 
-	case '\x08':
-	case '\x7F':
-		// Backspace (^H)
-		// Delete (^?)
-		if (!line_buffer_.empty()) {
-			line_buffer_.pop_back();
-		}
-		break;
+		count++;
 
-	case '\x0A':
-		// Line feed (^J)
-		if (previous_ != '\x0D') {
-			process_password(true);
-		}
-		break;
+		switch (c) {
+		case '\x03':
+			// Interrupt (^C)
+			process_password(false);
+			break;
 
-	case '\x0C':
-		// New page (^L)
-		erase_current_line();
-		prompt_displayed_ = false;
-		display_prompt();
-		break;
+		case '\x08':
+		case '\x7F':
+			// Backspace (^H)
+			// Delete (^?)
+			if (!line_buffer_.empty()) {
+				line_buffer_.pop_back();
+			}
+			break;
 
-	case '\x0D':
-		// Carriage return (^M)
-		process_password(true);
-		break;
+		case '\x0A':
+			// Line feed (^J)
+			if (previous_ != '\x0D') {
+				process_password(true);
+			}
+			break;
 
-	case '\x15':
-		// Delete line (^U)
-		line_buffer_.clear();
-		break;
+		case '\x0C':
+			// New page (^L)
+			erase_current_line();
+			prompt_displayed_ = false;
+			display_prompt();
+			break;
 
-	case '\x17':
-		// Delete word (^W)
-		delete_buffer_word(false);
-		break;
+		case '\x0D':
+			// Carriage return (^M)
+			process_password(true);
+			break;
+
+		case '\x15':
+			// Delete line (^U)
+			line_buffer_.clear();
+			break;
+
+		case '\x17':
+			// Delete word (^W)
+			delete_buffer_word(false);
+			break;
 
-	default:
-		if (c >= '\x20' && c <= '\x7E') {
-			// ASCII text
-			if (line_buffer_.length() < maximum_command_line_length_) {
+		default:
+			if (c >= '\x20' && c <= '\x7E') {
+				// ASCII text
 				line_buffer_.push_back(c);
 			}
+			break;
+		}
+
+		previous_ = c;
+
+		// Password entry has finished, any remaining input is for the next mode
+		if (mode_ != Mode::PASSWORD || !running()) {
+			break;
 		}
-		break;
 	}
 
-	previous_ = c;
+	if (count == 0) {
+		check_idle_timeout();
+		return;
+	}
 
 	// This is a hack to let TelnetStream know that command
 	// execution is complete and that output can be flushed.
+	flush();
 	stream_.available();
 
 	idle_time_ = uuid::get_uptime_ms();
@@ -334,7 +390,20 @@ void Shell::loop_blocking() {
 	 * the std::function on every loop execution (to ensure that the
 	 * function captures aren't destroyed while executing).
 	 */
-	if (blocking_data->blocking_function_(*this, blocking_data->stop_)) {
+	bool finished;
+
+	if (blocking_data->task_) {
+		if (!blocking_ready()) {
+			return;
+		}
+
+		blocking_data->wait_ = blocking_data->task_->resume(*this, blocking_data->stop_);
+		finished = blocking_data->wait_.type_ == Task::Wait::Type::DONE;
+	} else {
+		finished = blocking_data->blocking_function_(*this, blocking_data->stop_);
+	}
+
+	if (finished) {
 		bool stop_pending = blocking_data->stop_;
 
 		mode_ = Mode::NORMAL;
@@ -367,6 +436,7 @@ void Shell::delay_until(uint64_t ms, delay_function function) {
 	if (mode_ == Mode::NORMAL) {
 		mode_ = Mode::DELAY;
 		mode_data_ = std::make_unique<Shell::DelayData>(ms, std::move(function));
+		schedule_timer(ms);
 	}
 }
 
@@ -377,6 +447,59 @@ void Shell::block_with(blocking_function function) {
 	}
 }
 
+void Shell::output_with(output_function function) {
+	block_with([function] (Shell &shell, bool stop) -> bool {
+		if (stop) {
+			return true;
+		}
+
+		int available = shell.availableForWrite();
+
+		if (available <= 0) {
+			return false;
+		}
+
+		return function(shell, available);
+	});
+}
+
+void Shell::run_task(std::unique_ptr<Task> task) {
+	if (mode_ == Mode::NORMAL) {
+		auto blocking_data = std::make_unique<Shell::BlockingData>(blocking_function{});
+
+		blocking_data->task_ = std::move(task);
+		mode_ = Mode::BLOCKING;
+		mode_data_ = std::move(blocking_data);
+	}
+}
+
+bool Shell::blocking_ready() {
+	auto *blocking_data = reinterpret_cast<Shell::BlockingData*>(mode_data_.get());
+
+	if (!blocking_data->task_ || blocking_data->stop_) {
+		return true;
+	}
+
+	auto &wait = blocking_data->wait_;
+
+	switch (wait.type_) {
+	case Task::Wait::Type::INPUT:
+		return available() > 0;
+
+	case Task::Wait::Type::TIME:
+		return uuid::get_uptime_ms() >= wait.value_;
+
+	case Task::Wait::Type::OUTPUT:
+		return availableForWrite() >= 0 && static_cast<size_t>(availableForWrite()) >= wait.value_;
+
+	case Task::Wait::Type::DONE:
+	case Task::Wait::Type::YIELD:
+		break;
+	}
+
+	return true;
+}
+
 void Shell::delete_buffer_word(bool display) {
 	size_t pos = line_buffer_.find_last_of(' ');
 
@@ -400,16 +523,55 @@ size_t Shell::maximum_command_line_length() const {
 }
 
 void Shell::maximum_command_line_length(size_t length) {
-	maximum_command_line_length_ = std::max((size_t)1, length);
-	line_buffer_.reserve(maximum_command_line_length_);
+	line_buffer_.capacity(std::max((size_t)1, length));
+	maximum_command_line_length_ = line_buffer_.capacity();
+}
+
+size_t Shell::maximum_input_batch() const {
+	return maximum_input_batch_;
+}
+
+void Shell::maximum_input_batch(size_t count) {
+	maximum_input_batch_ = std::max((size_t)1, count);
+}
+
+size_t Shell::maximum_argument_completions() const {
+	return maximum_argument_completions_;
+}
+
+void Shell::maximum_argument_completions(size_t count) {
+	maximum_argument_completions_ = count;
+}
+
+bool Shell::completion_cache() const {
+	return (bool)completion_cache_;
+}
+
+void Shell::completion_cache(bool enabled) {
+	if (!enabled) {
+		completion_cache_.reset();
+	} else if (!completion_cache_) {
+		completion_cache_ = std::make_unique<Commands::CompletionCache>();
+	}
+}
+
+void Shell::clear_completion_cache() {
+	if (completion_cache_) {
+		*completion_cache_ = Commands::CompletionCache{};
+	}
 }
 
 void Shell::process_command() {
-	CommandLine command_line{line_buffer_};
+	CommandLine command_line{line_buffer_.c_str(), line_buffer_.length()};
 
 	line_buffer_.clear();
+	process_command(std::move(command_line));
+}
+
+void Shell::process_command(CommandLine &&command_line) {
 	println();
 	prompt_displayed_ = false;
+	clear_completion_cache();
 
 	if (!command_line->empty()) {
 		if (commands_) {
@@ -430,10 +592,10 @@ void Shell::process_command() {
 }
 
 void Shell::process_completion() {
-	CommandLine command_line{line_buffer_};
+	CommandLine command_line{line_buffer_.c_str(), line_buffer_.length()};
 
 	if (!command_line->empty() && commands_) {
-		auto completion = commands_->complete_command(*this, command_line);
+		auto completion = commands_->complete_command(*this, command_line, completion_cache_.get());
 		bool redisplay = false;
 
 		if (!completion.help.empty()) {
@@ -447,14 +609,13 @@ void Shell::process_completion() {
 			}
 		}
 
-		if (!completion.replacement->empty()) {
+		// The command line is left unchanged if the replacement is too long
+		if (!completion.replacement->empty() && completion.replacement.to_string(line_buffer_)) {
 			if (!redisplay) {
 				erase_current_line();
 				prompt_displayed_ = false;
 				redisplay = true;
 			}
-
-			line_buffer_ = completion.replacement.to_string(maximum_command_line_length_);
 		}
 
 		if (redisplay) {
@@ -474,7 +635,7 @@ void Shell::process_password(bool completed) {
 	mode_ = Mode::NORMAL;
 	mode_data_.reset();
 
-	function_copy(*this, completed, line_buffer_);
+	function_copy(*this, completed, line_buffer_.str());
 	line_buffer_.clear();
 
 	if (running()) {
@@ -490,9 +651,9 @@ void Shell::invoke_command(const std::string &line) {
 	if (!prompt_displayed_) {
 		display_prompt();
 	}
-	line_buffer_ = line;
-	print(line_buffer_);
-	process_command();
+	line_buffer_.clear();
+	print(line);
+	process_command(CommandLine{line});
 }
 
 unsigned long Shell::idle_timeout() const {
@@ -501,6 +662,7 @@ unsigned long Shell::idle_timeout() const {
 
 void Shell::idle_timeout(unsigned long timeout) {
 	idle_timeout_ = (uint64_t)timeout * 1000;
+	schedule_timer(deadline());
 }
 
 void Shell::check_idle_timeout() {
@@ -510,6 +672,77 @@ void Shell::check_idle_timeout() {
 	}
 }
 
+bool Shell::ready() {
+	if (!running()) {
+		return false;
+	}
+
+	if (timer_expired_) {
+		return true;
+	}
+
+	if (mode_ == Mode::BLOCKING) {
+		return blocking_ready();
+	}
+
+	{
+#if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+		std::lock_guard<std::mutex> lock{mutex_};
+#endif
+
+		if (!log_messages_.empty()) {
+			return true;
+		}
+	}
+
+	if (deferred_log_message_.content_) {
+		// Wait for space to output the deferred log message before
+		// checking for more log messages or input
+		return availableForWrite() >= 0 && static_cast<size_t>(availableForWrite()) >= deferred_log_space_;
+	}
+
+	if (shared_log_queue_ && shared_log_queue_->available(log_message_output_id_) > 0) {
+		return true;
+	}
+
+	// Input is not read while a delay is active
+	return mode_ != Mode::DELAY && stream_.available() > 0;
+}
+
+uint64_t Shell::deadline() const {
+	uint64_t time = UINT64_MAX;
+
+	switch (mode_) {
+	case Mode::DELAY:
+		time = reinterpret_cast<Shell::DelayData*>(mode_data_.get())->delay_time_;
+		break;
+
+	case Mode::NORMAL:
+	case Mode::PASSWORD:
+		if (idle_timeout_ > 0) {
+			time = idle_time_ + idle_timeout_;
+		}
+		break;
+
+	case Mode::BLOCKING: {
+			auto *blocking_data = reinterpret_cast<Shell::BlockingData*>(mode_data_.get());
+
+			if (blocking_data->task_ && blocking_data->wait_.type_ == Task::Wait::Type::TIME) {
+				time = blocking_data->wait_.value_;
+			}
+		}
+		break;
+	}
+
+	if (deferred_log_message_.content_) {
+		// Poll the stream until there is space to output the deferred
+		// log message
+		time = std::min(time, deferred_log_time_ + LOG_OUTPUT_RETRY_MS);
+	}
+
+	return time;
+}
+
 } // namespace console
 
 } // namespace uuid
@@ -23,10 +23,12 @@
 #include <algorithm>
 #include <memory>
 #if UUID_CONSOLE_THREAD_SAFE
+# include <atomic>
 # include <mutex>
 #endif
 #include <string>
 
+#include <uuid/common.h>
 #include <uuid/log.h>
 
 #ifndef PSTR_ALIGN
@@ -41,6 +43,140 @@ namespace console {
 static const char __pstr__logger_name[] __attribute__((__aligned__(PSTR_ALIGN))) PROGMEM = "shell";
 //! @endcond
 
+//! @cond false
+static const char __pstr__dropped_suffix[] __attribute__((__aligned__(PSTR_ALIGN))) PROGMEM = " log messages dropped";
+//! @endcond
+
+//! @cond false
+/*
+ * Log message formatted for output, so that it can be shared by every
+ * shell. The queued log message identifier is different for each shell
+ * so it needs to be inserted at id_position.
+ */
+struct FormattedLogMessage {
+	std::string text;
+	size_t id_position;
+};
+
+#if !(UUID_CONSOLE_LOCK_FREE_LOG_QUEUE && UUID_CONSOLE_THREAD_SAFE)
+/*
+ * Recently formatted log messages.
+ */
+struct FormattedLogMessageCache {
+	std::weak_ptr<const uuid::log::Message> message[Shell::MAX_LOG_MESSAGES];
+	std::shared_ptr<const FormattedLogMessage> formatted[Shell::MAX_LOG_MESSAGES];
+	size_t next = 0;
+#if UUID_CONSOLE_THREAD_SAFE
+	std::atomic<size_t> used{0};
+	std::mutex mutex;
+#else
+	size_t used = 0;
+#endif
+};
+
+static FormattedLogMessageCache formatted_log_messages;
+#endif
+//! @endcond
+
+static size_t decimal_length(unsigned long value) {
+	size_t length = 1;
+
+	while (value >= 10) {
+		value /= 10;
+		length++;
+	}
+
+	return length;
+}
+
+static std::shared_ptr<const FormattedLogMessage> create_formatted_log_message(const uuid::log::Message &message) {
+	auto formatted = std::make_shared<FormattedLogMessage>();
+	std::string name = read_flash_string(message.name);
+
+	formatted->text.reserve(20 + name.length() + message.text.length());
+	formatted->text = uuid::log::format_timestamp_ms(message.uptime_ms, 3);
+	formatted->text += ' ';
+	formatted->text += uuid::log::format_level_char(message.level);
+	formatted->text += ' ';
+	formatted->id_position = formatted->text.length();
+	formatted->text += ':';
+	formatted->text += ' ';
+	formatted->text += '[';
+	formatted->text += name;
+	formatted->text += ']';
+	formatted->text += ' ';
+	formatted->text += message.text;
+	formatted->text += '\r';
+	formatted->text += '\n';
+
+	return formatted;
+}
+
+static std::shared_ptr<const FormattedLogMessage> format_log_message(const std::shared_ptr<const uuid::log::Message> &message) {
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE && UUID_CONSOLE_THREAD_SAFE
+	// Log messages are output without a mutex so every shell formats
+	// them separately (use a shared log queue to format them once)
+	return create_formatted_log_message(*message);
+#else
+	auto &cache = formatted_log_messages;
+	constexpr size_t size = sizeof(cache.message) / sizeof(cache.message[0]);
+	size_t unused = size;
+	// No other shell has this message so it won't be needed again
+	bool last = message.use_count() == 1;
+
+	if (last && cache.used == 0) {
+		return create_formatted_log_message(*message);
+	}
+
+	{
+#if UUID_CONSOLE_THREAD_SAFE
+		std::lock_guard<std::mutex> lock{cache.mutex};
+#endif
+
+		for (size_t i = 0; i < size; i++) {
+			if (cache.message[i].expired()) {
+				// Every shell has finished with this message
+				if (cache.formatted[i]) {
+					cache.formatted[i].reset();
+					cache.used--;
+				}
+				unused = i;
+			} else if (!cache.message[i].owner_before(message) && !message.owner_before(cache.message[i])) {
+				if (last) {
+					cache.message[i].reset();
+					cache.used--;
+					return std::move(cache.formatted[i]);
+				}
+
+				return cache.formatted[i];
+			}
+		}
+	}
+
+	auto formatted = create_formatted_log_message(*message);
+
+	if (!last) {
+#if UUID_CONSOLE_THREAD_SAFE
+		std::lock_guard<std::mutex> lock{cache.mutex};
+#endif
+
+		if (unused == size) {
+			unused = cache.next;
+			cache.next = (cache.next + 1) % size;
+		}
+
+		if (!cache.formatted[unused]) {
+			cache.used++;
+		}
+
+		cache.message[unused] = message;
+		cache.formatted[unused] = formatted;
+	}
+
+	return formatted;
+#endif
+}
+
 const uuid::log::Logger& Shell::logger() {
 	static const uuid::log::Logger logger_instance{reinterpret_cast<const __FlashStringHelper *>(__pstr__logger_name), uuid::log::Facility::LPR};
 
@@ -52,16 +188,94 @@ Shell::QueuedLogMessage::QueuedLogMessage(unsigned long id, std::shared_ptr<uuid
 
 }
 
-void Shell::operator<<(std::shared_ptr<uuid::log::Message> message) {
+Shell::SharedLogQueue::SharedLogQueue(size_t capacity)
+		: messages_(new QueuedLogMessage[std::max((size_t)1, capacity)]),
+		capacity_(std::max((size_t)1, capacity)) {
+	uuid::log::Logger::register_handler(this, uuid::log::Level::NOTICE);
+}
+
+uuid::log::Level Shell::SharedLogQueue::log_level() const {
+	return uuid::log::Logger::get_log_level(this);
+}
+
+void Shell::SharedLogQueue::log_level(uuid::log::Level level) {
+	uuid::log::Logger::register_handler(this, level);
+}
+
+void Shell::SharedLogQueue::operator<<(std::shared_ptr<uuid::log::Message> message) {
+	auto formatted = create_formatted_log_message(*message);
+
+#if UUID_CONSOLE_THREAD_SAFE
+	std::lock_guard<std::mutex> lock{mutex_};
+#endif
+	size_t position = head_ + size_;
+
+	if (position >= capacity_) {
+		position -= capacity_;
+	}
+
+	messages_[position].id_ = next_id_++;
+	messages_[position].content_ = std::move(message);
+	messages_[position].formatted_ = std::move(formatted);
+
+	if (size_ == capacity_) {
+		// The oldest message has been overwritten
+		head_ = (head_ + 1 == capacity_) ? 0 : head_ + 1;
+	} else {
+		size_++;
+	}
+}
+
+unsigned long Shell::SharedLogQueue::next_id() const {
+#if UUID_CONSOLE_THREAD_SAFE
+	std::lock_guard<std::mutex> lock{mutex_};
+#endif
+
+	return next_id_;
+}
+
+size_t Shell::SharedLogQueue::available(unsigned long id) const {
 #if UUID_CONSOLE_THREAD_SAFE
 	std::lock_guard<std::mutex> lock{mutex_};
 #endif
+	unsigned long pending = next_id_ - id;
+
+	return pending < size_ ? pending : size_;
+}
+
+bool Shell::SharedLogQueue::read(unsigned long id, QueuedLogMessage &message) const {
+#if UUID_CONSOLE_THREAD_SAFE
+	std::lock_guard<std::mutex> lock{mutex_};
+#endif
+	unsigned long pending = next_id_ - id;
+
+	if (pending > size_) {
+		// Continue from the oldest message that is still available
+		pending = size_;
+	}
+
+	if (pending == 0) {
+		return false;
+	}
+
+	size_t position = head_ + (size_ - pending);
 
-	if (log_messages_.size() >= maximum_log_messages_) {
-		log_messages_.pop_front();
+	if (position >= capacity_) {
+		position -= capacity_;
 	}
 
-	log_messages_.emplace_back(log_message_id_++, std::move(message));
+	message.id_ = messages_[position].id_;
+	message.content_ = messages_[position].content_;
+	message.formatted_ = messages_[position].formatted_;
+	return true;
+}
+
+void Shell::operator<<(std::shared_ptr<uuid::log::Message> message) {
+#if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+	std::lock_guard<std::mutex> lock{mutex_};
+#endif
+
+	log_messages_.push(std::move(message));
 }
 
 uuid::log::Level Shell::log_level() const {
@@ -69,53 +283,256 @@ uuid::log::Level Shell::log_level() const {
 }
 
 void Shell::log_level(uuid::log::Level level) {
+	if (shared_log_queue_) {
+		// Log messages are received by the shared queue instead
+		return;
+	}
+
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+	log_handler_registered_ = true;
+#endif
 	uuid::log::Logger::register_handler(this, level);
 }
 
+void Shell::shared_log_queue(std::shared_ptr<SharedLogQueue> queue) {
+	if (started_) {
+		// The log handler may already be registered
+		return;
+	}
+
+	shared_log_queue_ = std::move(queue);
+
+	if (shared_log_queue_) {
+		log_message_output_id_ = shared_log_queue_->next_id();
+		maximum_log_messages(1);
+	} else {
+		maximum_log_messages(MAX_LOG_MESSAGES);
+	}
+}
+
 size_t Shell::maximum_log_messages() const {
-#if UUID_CONSOLE_THREAD_SAFE
+#if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
 	std::lock_guard<std::mutex> lock{mutex_};
 #endif
 
-	return maximum_log_messages_;
+	return log_messages_.capacity();
 }
 
 void Shell::maximum_log_messages(size_t count) {
-#if UUID_CONSOLE_THREAD_SAFE
+#if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
 	std::lock_guard<std::mutex> lock{mutex_};
 #endif
 
-	maximum_log_messages_ = std::max((size_t)1, count);
-	while (log_messages_.size() > maximum_log_messages_) {
-		log_messages_.pop_front();
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+	if (log_handler_registered_) {
+		// Log messages could be added concurrently
+		return;
 	}
+#endif
+
+	log_messages_.capacity(count);
 }
 
-void Shell::output_logs() {
-#if UUID_CONSOLE_THREAD_SAFE
-	std::unique_lock<std::mutex> lock{mutex_};
+size_t Shell::maximum_log_output_messages() const {
+	return maximum_log_output_messages_;
+}
+
+void Shell::maximum_log_output_messages(size_t count) {
+	maximum_log_output_messages_ = std::max((size_t)1, count);
+}
+
+size_t Shell::maximum_log_output_bytes() const {
+	return maximum_log_output_bytes_;
+}
+
+void Shell::maximum_log_output_bytes(size_t bytes) {
+	maximum_log_output_bytes_ = bytes;
+}
+
+unsigned long Shell::maximum_log_output_time() const {
+	return maximum_log_output_time_;
+}
+
+void Shell::maximum_log_output_time(unsigned long time_us) {
+	maximum_log_output_time_ = time_us;
+}
+
+size_t Shell::terminal_width() const {
+	return terminal_width_;
+}
+
+void Shell::terminal_width(size_t columns) {
+	terminal_width_ = columns;
+}
+
+bool Shell::log_output_backpressure() const {
+	return log_output_backpressure_;
+}
+
+void Shell::log_output_backpressure(bool enabled) {
+	log_output_backpressure_ = enabled;
+}
+
+#if UUID_CONSOLE_STATISTICS
+Shell::Statistics Shell::statistics() const {
+	Statistics statistics = statistics_;
+
+	{
+# if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+		std::lock_guard<std::mutex> lock{mutex_};
+# endif
+
+		statistics.log_messages_queued = log_messages_.size();
+	}
+
+	if (shared_log_queue_) {
+		statistics.log_messages_queued += shared_log_queue_->available(log_message_output_id_);
+	}
+
+	if (deferred_log_message_.content_) {
+		statistics.log_messages_queued++;
+	}
+
+	statistics.log_messages_queued += statistics.log_messages_output + statistics.log_messages_dropped;
+	return statistics;
+}
+
+void Shell::reset_statistics() {
+	statistics_ = Statistics{};
+}
 #endif
 
-	if (log_messages_.empty())
-		return;
+bool Shell::next_log_message(QueuedLogMessage &message) {
+	if (deferred_log_message_.content_) {
+		message.id_ = deferred_log_message_.id_;
+		message.content_ = std::move(deferred_log_message_.content_);
+		message.formatted_ = std::move(deferred_log_message_.formatted_);
+		return true;
+	}
 
-	size_t count = std::max((size_t)1, MAX_LOG_MESSAGES);
-	auto message = log_messages_.front();
+	if (shared_log_queue_) {
+		return shared_log_queue_->read(log_message_output_id_, message);
+	}
 
-	log_messages_.pop_front();
-#if UUID_CONSOLE_THREAD_SAFE
-	lock.unlock();
+#if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+	std::lock_guard<std::mutex> lock{mutex_};
 #endif
 
-	if (mode_ != Mode::DELAY) {
-		erase_current_line();
-		prompt_displayed_ = false;
+	return log_messages_.pop(message);
+}
+
+void Shell::output_logs() {
+	QueuedLogMessage message;
+
+#if UUID_CONSOLE_STATISTICS
+	{
+# if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+		std::lock_guard<std::mutex> lock{mutex_};
+# endif
+		size_t size = log_messages_.size() + (deferred_log_message_.content_ ? 1 : 0);
+
+		if (shared_log_queue_) {
+			size += shared_log_queue_->available(log_message_output_id_);
+		}
+
+		// Messages are only removed from the queue when they're output
+		statistics_.log_messages_maximum = std::max(statistics_.log_messages_maximum, size);
 	}
+#endif
+
+	if (!next_log_message(message))
+		return;
+
+	size_t count = maximum_log_output_messages_;
+	size_t bytes = 0;
+	unsigned long start_us = maximum_log_output_time_ ? ::micros() : 0;
+
+	// Insert log messages above the command line if it fits on one line
+	bool insert = terminal_width_ > 0 && mode_ == Mode::NORMAL && prompt_displayed_
+		&& prompt_length_ + line_buffer_.length() < terminal_width_;
+	bool output = false;
 
 	while (1) {
-		print(uuid::log::format_timestamp_ms(message.content_->uptime_ms, 3));
-		printf(F(" %c %lu: [%S] "), uuid::log::format_level_char(message.content_->level), message.id_, message.content_->name);
-		println(message.content_->text);
+		auto formatted = message.formatted_ ? message.formatted_ : format_log_message(message.content_);
+		auto text = reinterpret_cast<const uint8_t *>(formatted->text.data());
+		// Messages are discarded when the queue is full
+		unsigned long discarded = message.id_ - log_message_output_id_;
+		unsigned long dropped = log_output_backpressure_ ? discarded : 0;
+		// Exclude the line endings but include the identifier
+		size_t length = formatted->text.length() - 2 + decimal_length(message.id_);
+		size_t dropped_length = dropped > 0 ? decimal_length(dropped) + sizeof(__pstr__dropped_suffix) - 1 : 0;
+		unsigned int lines = 0;
+
+		if (insert) {
+			lines = (length + terminal_width_ - 1) / terminal_width_
+				+ (dropped_length + terminal_width_ - 1) / terminal_width_;
+		}
+
+		if (log_output_backpressure_) {
+			size_t required = (dropped > 0 ? dropped_length + 2 : 0) + length + 2;
+
+			if (insert) {
+				// Scroll, insert lines and return to the command line
+				required += lines * 2 + 13 + 3 * decimal_length(lines);
+			} else if (mode_ != Mode::DELAY) {
+				// Erase and output the command line again
+				required += 6 + prompt_length_ + line_buffer_.length();
+			}
+
+			size_t available = std::max(0, availableForWrite());
+
+			// The log message may never fit if it's larger than the
+			// capacity of the stream, so wait until it's empty instead
+			log_output_capacity_ = std::max(log_output_capacity_, available);
+			required = std::min(required, log_output_capacity_);
+
+			if (available < required || required == 0) {
+				deferred_log_space_ = std::max(required, (size_t)1);
+				deferred_log_time_ = uuid::get_uptime_ms();
+				deferred_log_message_.id_ = message.id_;
+				deferred_log_message_.content_ = std::move(message.content_);
+				deferred_log_message_.formatted_ = std::move(message.formatted_);
+				break;
+			}
+		}
+
+		if (!output) {
+			if (mode_ != Mode::DELAY && !insert) {
+				erase_current_line();
+				prompt_displayed_ = false;
+			}
+
+			output = true;
+		}
+
+		if (insert) {
+			// Scroll down if the command line is at the bottom of the
+			// screen and then insert lines above it
+			for (unsigned int i = 0; i < lines; i++) {
+				bytes += print(F("\033D"));
+			}
+			bytes += printf(F("\033[%uA\033" "7\033[%uL"), lines, lines);
+		}
+
+		if (dropped > 0) {
+			bytes += printf(F("%lu"), dropped);
+			bytes += print(reinterpret_cast<const __FlashStringHelper *>(__pstr__dropped_suffix));
+			bytes += println();
+		}
+
+		bytes += write(text, formatted->id_position);
+		bytes += printf(F("%lu"), message.id_);
+		bytes += write(text + formatted->id_position, formatted->text.length() - formatted->id_position);
+		log_message_output_id_ = message.id_ + 1;
+#if UUID_CONSOLE_STATISTICS
+		statistics_.log_messages_dropped += discarded;
+		statistics_.log_messages_output++;
+#endif
+
+		if (insert) {
+			// Return to the position on the command line
+			bytes += printf(F("\033" "8\033[%uB"), lines);
+		}
 
 		::yield();
 
@@ -124,24 +541,22 @@ void Shell::output_logs() {
 			break;
 		}
 
-#if UUID_CONSOLE_THREAD_SAFE
-		lock.lock();
-#endif
-		if (log_messages_.empty()) {
-#if UUID_CONSOLE_THREAD_SAFE
-			lock.unlock();
-#endif
+		if (maximum_log_output_bytes_ && bytes >= maximum_log_output_bytes_) {
 			break;
 		}
 
-		message = log_messages_.front();
-		log_messages_.pop_front();
-#if UUID_CONSOLE_THREAD_SAFE
-		lock.unlock();
-#endif
+		if (maximum_log_output_time_ && ::micros() - start_us >= maximum_log_output_time_) {
+			break;
+		}
+
+		if (!next_log_message(message)) {
+			break;
+		}
 	}
 
-	display_prompt();
+	if (output && !insert) {
+		display_prompt();
+	}
 }
 
 } // namespace console
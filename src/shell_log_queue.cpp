@@ -0,0 +1,264 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <uuid/console.h>
+
+#include <algorithm>
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+# include <atomic>
+# include <cstddef>
+#endif
+#include <memory>
+#include <utility>
+
+#include <uuid/log.h>
+
+namespace uuid {
+
+namespace console {
+
+Shell::LogMessageQueue::LogMessageQueue(size_t capacity) {
+	this->capacity(capacity);
+}
+
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+void Shell::LogMessageQueue::capacity(size_t capacity) {
+	size_t rounded = 1;
+
+	while (rounded < capacity) {
+		rounded <<= 1;
+	}
+
+	if (rounded == capacity_) {
+		return;
+	}
+
+	std::unique_ptr<Slot[]> slots{new Slot[rounded]};
+	size_t size = 0;
+
+	if (slots_) {
+		std::shared_ptr<uuid::log::Message> content;
+
+		update_discarded();
+
+		// Keep the newest messages
+		while (this->size() > rounded) {
+			pop(content);
+			next_id_++;
+		}
+
+		// Positions restart from 0
+		size_t head = head_.load(std::memory_order_relaxed);
+
+		pending_discarded_position_ = static_cast<std::ptrdiff_t>(pending_discarded_position_ - head) > 0
+			? pending_discarded_position_ - head : 0;
+
+		while (pop(content)) {
+			slots[size++].content = std::move(content);
+		}
+	}
+
+# if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE > 1
+	for (size_t i = 0; i < rounded; i++) {
+		slots[i].sequence.store(i < size ? i + 1 : i, std::memory_order_relaxed);
+	}
+# endif
+
+	slots_ = std::move(slots);
+	capacity_ = rounded;
+	head_.store(0, std::memory_order_relaxed);
+	tail_.store(size, std::memory_order_release);
+}
+
+size_t Shell::LogMessageQueue::size() const {
+	// The head must be read first so that it can't be after the tail
+	size_t head = head_.load(std::memory_order_acquire);
+
+	return tail_.load(std::memory_order_acquire) - head;
+}
+
+bool Shell::LogMessageQueue::pop(QueuedLogMessage &message) {
+	size_t position = head_.load(std::memory_order_relaxed);
+	std::shared_ptr<uuid::log::Message> content;
+
+	if (!pop(content)) {
+		return false;
+	}
+
+	update_discarded();
+
+	// Producers can claim positions in a different order to the order
+	// that they received their messages in, so identifiers are only
+	// assigned when messages are removed from the queue. Discarded
+	// messages are skipped after all of the messages before them.
+	if (pending_discarded_ > 0
+			&& static_cast<std::ptrdiff_t>(position - pending_discarded_position_) >= 0) {
+		next_id_ += pending_discarded_;
+		pending_discarded_ = 0;
+	}
+
+	message.id_ = next_id_++;
+	message.content_ = std::move(content);
+	return true;
+}
+
+void Shell::LogMessageQueue::update_discarded() {
+	unsigned long discarded = discarded_.exchange(0, std::memory_order_acquire);
+
+	if (discarded > 0) {
+		// Messages are discarded when the queue is full, so they are
+		// after all of the messages that are currently in the queue
+		pending_discarded_ += discarded;
+		pending_discarded_position_ = tail_.load(std::memory_order_relaxed);
+	}
+}
+
+# if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE > 1
+void Shell::LogMessageQueue::push(std::shared_ptr<uuid::log::Message> &&content) {
+	size_t tail = tail_.load(std::memory_order_relaxed);
+
+	while (true) {
+		auto &slot = slots_[tail & (capacity_ - 1)];
+		size_t sequence = slot.sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t available = static_cast<std::ptrdiff_t>(sequence - tail);
+
+		if (available == 0) {
+			// Claim this slot, otherwise retry with the updated tail
+			if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+				slot.content = std::move(content);
+				slot.sequence.store(tail + 1, std::memory_order_release);
+				return;
+			}
+		} else if (available < 0) {
+			// The queue is full
+			discarded_.fetch_add(1, std::memory_order_release);
+			return;
+		} else {
+			// Another producer has claimed this slot
+			tail = tail_.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool Shell::LogMessageQueue::pop(std::shared_ptr<uuid::log::Message> &content) {
+	size_t head = head_.load(std::memory_order_relaxed);
+	auto &slot = slots_[head & (capacity_ - 1)];
+
+	if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+		return false;
+	}
+
+	content = std::move(slot.content);
+
+	slot.sequence.store(head + capacity_, std::memory_order_release);
+	head_.store(head + 1, std::memory_order_release);
+	return true;
+}
+# else
+void Shell::LogMessageQueue::push(std::shared_ptr<uuid::log::Message> &&content) {
+	size_t tail = tail_.load(std::memory_order_relaxed);
+
+	if (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+		// The queue is full
+		discarded_.fetch_add(1, std::memory_order_release);
+		return;
+	}
+
+	slots_[tail & (capacity_ - 1)].content = std::move(content);
+	tail_.store(tail + 1, std::memory_order_release);
+}
+
+bool Shell::LogMessageQueue::pop(std::shared_ptr<uuid::log::Message> &content) {
+	size_t head = head_.load(std::memory_order_relaxed);
+
+	if (head == tail_.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	content = std::move(slots_[head & (capacity_ - 1)].content);
+	head_.store(head + 1, std::memory_order_release);
+	return true;
+}
+# endif
+#else
+void Shell::LogMessageQueue::capacity(size_t capacity) {
+	capacity = std::max((size_t)1, capacity);
+
+	if (capacity == capacity_) {
+		return;
+	}
+
+	std::unique_ptr<QueuedLogMessage[]> messages{new QueuedLogMessage[capacity]};
+	size_t size = 0;
+
+	// Keep the newest messages
+	while (size_ > capacity) {
+		QueuedLogMessage discard;
+
+		pop(discard);
+	}
+
+	while (!empty()) {
+		pop(messages[size++]);
+	}
+
+	messages_ = std::move(messages);
+	capacity_ = capacity;
+	head_ = 0;
+	size_ = size;
+}
+
+size_t Shell::LogMessageQueue::size() const {
+	return size_;
+}
+
+void Shell::LogMessageQueue::push(std::shared_ptr<uuid::log::Message> &&content) {
+	size_t position = head_ + size_;
+
+	if (position >= capacity_) {
+		position -= capacity_;
+	}
+
+	messages_[position].id_ = next_id_++;
+	messages_[position].content_ = std::move(content);
+
+	if (size_ == capacity_) {
+		// The oldest message has been overwritten
+		head_ = (head_ + 1 == capacity_) ? 0 : head_ + 1;
+	} else {
+		size_++;
+	}
+}
+
+bool Shell::LogMessageQueue::pop(QueuedLogMessage &message) {
+	if (size_ == 0) {
+		return false;
+	}
+
+	message.id_ = messages_[head_].id_;
+	message.content_ = std::move(messages_[head_].content_);
+
+	head_ = (head_ + 1 == capacity_) ? 0 : head_ + 1;
+	size_--;
+	return true;
+}
+#endif
+
+} // namespace console
+
+} // namespace uuid
@@ -18,32 +18,182 @@
 
 #include <uuid/console.h>
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#if UUID_CONSOLE_THREAD_SAFE
+# include <mutex>
+#endif
 #include <set>
+#include <utility>
+#include <vector>
+
+#include <uuid/common.h>
 
 namespace uuid {
 
 namespace console {
 
-std::set<std::shared_ptr<Shell>>& Shell::registered_shells() {
-	static std::set<std::shared_ptr<Shell>> shells;
+Shell::Group& Shell::default_group() {
+	static Group group;
 
-	return shells;
+	return group;
 }
 
 void Shell::loop_all() {
-	auto& shells = registered_shells();
+	default_group().loop_all();
+}
+
+unsigned long Shell::loop_all_ready() {
+	return default_group().loop_all_ready();
+}
+
+Shell::Group::~Group() {
+	// The timers are discarded with the group
+	for (auto &shell : shells_) {
+		shell->timer_ = UINT64_MAX;
+		shell->group_ = nullptr;
+	}
+}
+
+void Shell::Group::add(std::shared_ptr<Shell> shell) {
+#if UUID_CONSOLE_THREAD_SAFE
+	std::lock_guard<std::mutex> lock{mutex_};
+#endif
+
+	pending_.push_back(std::move(shell));
+}
+
+void Shell::Group::add_pending() {
+#if UUID_CONSOLE_THREAD_SAFE
+	std::vector<std::shared_ptr<Shell>> pending;
+
+	{
+		std::lock_guard<std::mutex> lock{mutex_};
+
+		if (pending_.empty()) {
+			return;
+		}
 
-	for (auto shell = shells.begin(); shell != shells.end(); ) {
+		std::swap(pending, pending_);
+	}
+#else
+	auto &pending = pending_;
+#endif
+
+	for (auto &shell : pending) {
+		shell->group_ = this;
+		shell->schedule_timer(shell->deadline());
+		shells_.insert(std::move(shell));
+	}
+
+	pending.clear();
+}
+
+std::set<std::shared_ptr<Shell>>::iterator Shell::Group::remove(std::set<std::shared_ptr<Shell>>::iterator shell) {
+	shell->get()->unschedule_timer();
+	shell->get()->group_ = nullptr;
+	return shells_.erase(shell);
+}
+
+void Shell::Group::loop_all() {
+	add_pending();
+
+	for (auto shell = shells_.begin(); shell != shells_.end(); ) {
 		shell->get()->loop_one();
 
 		// This avoids copying the shared_ptr every time loop_one() is called
 		if (!shell->get()->running()) {
-			shell = shells.erase(shell);
+			shell = remove(shell);
+		} else {
+			shell++;
+		}
+	}
+}
+
+unsigned long Shell::Group::loop_all_ready() {
+	add_pending();
+
+	uint64_t now = uuid::get_uptime_ms();
+	bool executed = false;
+
+	// Only the shells with expired timers need to check their deadline
+	while (!timers_.empty() && timers_.front().time <= now) {
+		auto timer = timers_.front();
+
+		std::pop_heap(timers_.begin(), timers_.end(), std::greater<Timer>());
+		timers_.pop_back();
+
+		if (timer.shell->timer_ == timer.time) {
+			timer.shell->timer_ = UINT64_MAX;
+
+			if (timer.shell->deadline() <= now) {
+				timer.shell->timer_expired_ = true;
+			} else {
+				timer.shell->schedule_timer(timer.shell->deadline());
+			}
+		}
+	}
+
+	for (auto shell = shells_.begin(); shell != shells_.end(); ) {
+		if (shell->get()->ready()) {
+			shell->get()->timer_expired_ = false;
+			shell->get()->loop_one();
+			shell->get()->schedule_timer(shell->get()->deadline());
+			executed = true;
+		}
+
+		if (!shell->get()->running()) {
+			shell = remove(shell);
 		} else {
 			shell++;
 		}
 	}
+
+	// Discard timers that have been replaced by an earlier timer
+	while (!timers_.empty() && timers_.front().shell->timer_ != timers_.front().time) {
+		std::pop_heap(timers_.begin(), timers_.end(), std::greater<Timer>());
+		timers_.pop_back();
+	}
+
+	if (executed) {
+		return 0;
+	} else if (timers_.empty()) {
+		return ULONG_MAX;
+	} else if (timers_.front().time <= now) {
+		return 0;
+	} else {
+		return std::min(timers_.front().time - now, (uint64_t)ULONG_MAX);
+	}
+}
+
+void Shell::schedule_timer(uint64_t time) {
+	// A later time will be rescheduled when the existing timer expires
+	if (group_ && time < timer_) {
+		auto& timers = group_->timers_;
+
+		timers.push_back(Timer{time, this});
+		std::push_heap(timers.begin(), timers.end(), std::greater<Timer>());
+		timer_ = time;
+	}
+}
+
+void Shell::unschedule_timer() {
+	if (group_) {
+		auto& timers = group_->timers_;
+		auto end = std::remove_if(timers.begin(), timers.end(),
+			[this] (const Timer &timer) { return timer.shell == this; });
+
+		// There may also be replaced timers for this shell
+		if (end != timers.end()) {
+			timers.erase(end, timers.end());
+			std::make_heap(timers.begin(), timers.end(), std::greater<Timer>());
+		}
+	}
+
+	timer_ = UINT64_MAX;
 }
 
 } // namespace console
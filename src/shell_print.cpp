@@ -85,16 +85,21 @@ size_t Shell::printfln(const __FlashStringHelper *format, ...) {
 
 size_t Shell::vprintf(const char *format, va_list ap) {
 	size_t print_len = 0;
+	char buffer[PRINTF_BUFFER_SIZE];
 	va_list copy_ap;
 
 	va_copy(copy_ap, ap);
 
-	int format_len = ::vsnprintf(nullptr, 0, format, ap);
+	int format_len = ::vsnprintf(buffer, sizeof(buffer), format, ap);
 	if (format_len > 0) {
-		std::string text(static_cast<std::string::size_type>(format_len), '\0');
-
-		::vsnprintf(&text[0], text.capacity() + 1, format, copy_ap);
-		print_len = print(text);
+		if (static_cast<size_t>(format_len) < sizeof(buffer)) {
+			print_len = write(reinterpret_cast<const uint8_t*>(buffer), format_len);
+		} else {
+			std::string text(static_cast<std::string::size_type>(format_len), '\0');
+
+			::vsnprintf(&text[0], text.capacity() + 1, format, copy_ap);
+			print_len = print(text);
+		}
 	}
 
 	va_end(copy_ap);
@@ -103,16 +108,21 @@ size_t Shell::vprintf(const char *format, va_list ap) {
 
 size_t Shell::vprintf(const __FlashStringHelper *format, va_list ap) {
 	size_t print_len = 0;
+	char buffer[PRINTF_BUFFER_SIZE];
 	va_list copy_ap;
 
 	va_copy(copy_ap, ap);
 
-	int format_len = ::vsnprintf_P(nullptr, 0, reinterpret_cast<PGM_P>(format), ap);
+	int format_len = ::vsnprintf_P(buffer, sizeof(buffer), reinterpret_cast<PGM_P>(format), ap);
 	if (format_len > 0) {
-		std::string text(static_cast<std::string::size_type>(format_len), '\0');
-
-		::vsnprintf_P(&text[0], text.capacity() + 1, reinterpret_cast<PGM_P>(format), copy_ap);
-		print_len = print(text);
+		if (static_cast<size_t>(format_len) < sizeof(buffer)) {
+			print_len = write(reinterpret_cast<const uint8_t*>(buffer), format_len);
+		} else {
+			std::string text(static_cast<std::string::size_type>(format_len), '\0');
+
+			::vsnprintf_P(&text[0], text.capacity() + 1, reinterpret_cast<PGM_P>(format), copy_ap);
+			print_len = print(text);
+		}
 	}
 
 	va_end(copy_ap);
@@ -120,13 +130,51 @@ size_t Shell::vprintf(const __FlashStringHelper *format, va_list ap) {
 }
 
 void Shell::print_all_available_commands() {
+	std::string line;
+
+	// Reuse the same line for every command instead of copying the name
+	// and arguments of each command into a CommandLine
+	line.reserve(maximum_command_line_length());
+
+	for (auto &available_command : available_commands()) {
+		line.clear();
+
+		for (auto name : available_command.flash_name()) {
+			CommandLine::format_flash_parameter(line, name, true);
+		}
+
+		for (auto argument : available_command.flash_arguments()) {
+			CommandLine::format_flash_parameter(line, argument, false);
+		}
+
+		println(line);
+	}
+}
+
+#if UUID_CONSOLE_STATISTICS
+void Shell::print_statistics() {
+	auto statistics = this->statistics();
+	std::string line;
+
+	printfln(F("Bytes written: %llu"), static_cast<unsigned long long>(statistics.bytes_written));
+	printfln(F("Log messages: %lu queued, %lu output, %lu dropped, %lu maximum queued"),
+		statistics.log_messages_queued, statistics.log_messages_output,
+		statistics.log_messages_dropped, static_cast<unsigned long>(statistics.log_messages_maximum));
+	printfln(F("Finding commands: %llu us"), static_cast<unsigned long long>(statistics.find_command_time));
+	printfln(F("Completing commands: %llu us"), static_cast<unsigned long long>(statistics.complete_command_time));
+
 	for (auto &available_command : available_commands()) {
-		CommandLine command_line{available_command.name(), available_command.arguments()};
+		line.clear();
+
+		for (auto name : available_command.flash_name()) {
+			CommandLine::format_flash_parameter(line, name, true);
+		}
 
-		command_line.escape_initial_parameters(available_command.name().size());
-		println(command_line.to_string(maximum_command_line_length()));
+		printfln(F("%s: %lu executions, %llu us"), line.c_str(), available_command.executions(),
+			static_cast<unsigned long long>(available_command.execution_time()));
 	}
 }
+#endif
 
 void Shell::erase_current_line() {
 	print(F("\033[G\033[K"));
@@ -44,6 +44,20 @@ std::string Shell::prompt_suffix() {
 	return std::string{'$'};
 }
 
+bool Shell::prompt_cache() const {
+	return prompt_cache_;
+}
+
+void Shell::prompt_cache(bool enabled) {
+	prompt_cache_ = enabled;
+	prompt_cached_ = false;
+
+	if (!enabled) {
+		prompt_.clear();
+		prompt_.shrink_to_fit();
+	}
+}
+
 void Shell::end_of_transmission() {
 	if (idle_timeout_ > 0) {
 		println();
@@ -51,6 +65,24 @@ void Shell::end_of_transmission() {
 	}
 }
 
+std::string Shell::prompt_text() {
+	std::string hostname = hostname_text();
+	std::string context = context_text();
+	std::string text = prompt_prefix();
+
+	if (!hostname.empty()) {
+		text += hostname;
+		text += ' ';
+	}
+	if (!context.empty()) {
+		text += context;
+		text += ' ';
+	}
+	text += prompt_suffix();
+	text += ' ';
+	return text;
+}
+
 void Shell::display_prompt() {
 	switch (mode_) {
 	case Mode::DELAY:
@@ -62,21 +94,17 @@ void Shell::display_prompt() {
 		break;
 
 	case Mode::NORMAL:
-		std::string hostname = hostname_text();
-		std::string context = context_text();
-
-		print(prompt_prefix());
-		if (!hostname.empty()) {
-			print(hostname);
-			print(' ');
-		}
-		if (!context.empty()) {
-			print(context);
-			print(' ');
+		if (prompt_cache_) {
+			if (!prompt_cached_) {
+				prompt_ = prompt_text();
+				prompt_cached_ = true;
+			}
+
+			prompt_length_ = print(prompt_);
+		} else {
+			prompt_length_ = print(prompt_text());
 		}
-		print(prompt_suffix());
-		print(' ');
-		print(line_buffer_);
+		print(line_buffer_.c_str());
 		prompt_displayed_ = true;
 		break;
 	}
@@ -19,6 +19,10 @@
 #include <uuid/console.h>
 
 #include <Arduino.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
 
 namespace uuid {
 
@@ -113,20 +117,129 @@ int Shell::peek() {
 	}
 }
 
+size_t Shell::read_bytes(uint8_t *buffer, size_t length) {
+	if (mode_ != Mode::BLOCKING || length == 0) {
+		return 0;
+	}
+
+	auto *blocking_data = reinterpret_cast<Shell::BlockingData*>(mode_data_.get());
+	size_t count = 0;
+
+	if (blocking_data->consume_line_feed_) {
+		const int input = read();
+
+		if (input < 0) {
+			return 0;
+		}
+
+		buffer[count++] = input;
+	}
+
+	const int available = stream_.available();
+
+	if (available > 0 && count < length) {
+		// This won't wait for input because it's already available
+		count += stream_.readBytes(reinterpret_cast<char *>(&buffer[count]),
+			std::min(length - count, static_cast<size_t>(available)));
+	}
+
+	if (count > 0) {
+		// Track read characters so that a final CR means we ignore the next LF
+		previous_ = buffer[count - 1];
+	}
+
+	return count;
+}
+
+int Shell::availableForWrite() {
+	int available = stream_.availableForWrite();
+
+	// Buffered output will be written to the stream first
+	if (available <= 0 || output_buffer_length_ >= static_cast<size_t>(available)) {
+		return 0;
+	}
+
+	return available - output_buffer_length_;
+}
+
 size_t Shell::write(uint8_t data) {
-	return stream_.write(data);
+#if UUID_CONSOLE_STATISTICS
+	statistics_.bytes_written++;
+#endif
+
+	if (output_buffer_size_ == 0) {
+		return stream_.write(data);
+	}
+
+	if (output_buffer_length_ == output_buffer_size_) {
+		flush();
+
+		if (output_buffer_length_ == output_buffer_size_) {
+			// The stream didn't accept any of the buffered output
+			return 0;
+		}
+	}
+
+	output_buffer_[output_buffer_length_++] = data;
+	return 1;
 }
 
 size_t Shell::write(const uint8_t *buffer, size_t size) {
-	return stream_.write(buffer, size);
-}
+#if UUID_CONSOLE_STATISTICS
+	statistics_.bytes_written += size;
+#endif
+
+	if (output_buffer_size_ == 0) {
+		return stream_.write(buffer, size);
+	}
+
+	if (size > output_buffer_size_ - output_buffer_length_) {
+		flush();
+
+		if (output_buffer_length_ == 0 && size >= output_buffer_size_) {
+			// Too large to be buffered
+			return stream_.write(buffer, size);
+		}
+
+		// Buffered output that the stream didn't accept must be
+		// written first, so only buffer as much as there is space for
+		size = std::min(size, output_buffer_size_ - output_buffer_length_);
+	}
 
+	::memcpy(&output_buffer_[output_buffer_length_], buffer, size);
+	output_buffer_length_ += size;
+	return size;
+}
 
 void Shell::flush() {
-	// This is a pure virtual function in Arduino's Stream class, which
-	// makes no sense because that class is for input and this is an
-	// output function. Later versions move it to Print as an empty
-	// virtual function so this is here for backward compatibility.
+	if (output_buffer_length_ > 0) {
+		size_t written = std::min(stream_.write(output_buffer_.get(), output_buffer_length_), output_buffer_length_);
+
+		// Keep the output that the stream didn't accept
+		output_buffer_length_ -= written;
+		if (output_buffer_length_ > 0) {
+			::memmove(&output_buffer_[0], &output_buffer_[written], output_buffer_length_);
+		}
+	}
+}
+
+size_t Shell::output_buffer_size() const {
+	return output_buffer_size_;
+}
+
+void Shell::output_buffer_size(size_t size) {
+	flush();
+
+	std::unique_ptr<uint8_t[]> buffer{size > 0 ? new uint8_t[size] : nullptr};
+
+	// Keep as much of the output that the stream didn't accept as possible
+	output_buffer_length_ = std::min(output_buffer_length_, size);
+	if (output_buffer_length_ > 0) {
+		::memcpy(&buffer[0], &output_buffer_[0], output_buffer_length_);
+	}
+
+	output_buffer_ = std::move(buffer);
+	output_buffer_size_ = size;
 }
 
 } // namespace console
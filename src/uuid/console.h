@@ -22,6 +22,7 @@
 #include <Arduino.h>
 
 #include <cstdarg>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <functional>
@@ -32,6 +33,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <uuid/common.h>
@@ -51,6 +53,21 @@
 # define UUID_CONSOLE_THREAD_SAFE 0
 #endif
 
+#ifndef UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+# define UUID_CONSOLE_LOCK_FREE_LOG_QUEUE 0
+#endif
+
+#ifndef UUID_CONSOLE_STATISTICS
+# define UUID_CONSOLE_STATISTICS 0
+#endif
+
+#ifndef UUID_CONSOLE_LINE_BUFFER_SIZE
+# define UUID_CONSOLE_LINE_BUFFER_SIZE 0
+#endif
+
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE || UUID_CONSOLE_THREAD_SAFE
+# include <atomic>
+#endif
 #if UUID_CONSOLE_THREAD_SAFE
 # include <mutex>
 #endif
@@ -79,12 +96,406 @@ static constexpr bool thread_safe = false;
 class Commands;
 class CommandLine;
 class Shell;
+//! @cond false
+struct FormattedLogMessage;
+//! @endcond
+
+/**
+ * Array of flash strings that is not copied.
+ *
+ * This refers to either a std::vector of flash strings or a null
+ * terminated array of flash strings (which may be in flash), so it is
+ * only valid for as long as the underlying array.
+ *
+ * @since 3.1.0
+ */
+class FlashStringArray {
+public:
+	using value_type = const __FlashStringHelper *; /*!< Type of the flash strings. @since 3.1.0 */
+	using const_iterator = const value_type *; /*!< Type of the flash string iterator. @since 3.1.0 */
+
+	/**
+	 * Create an empty array.
+	 *
+	 * @since 3.1.0
+	 */
+	FlashStringArray() = default;
+	/**
+	 * Create an array that refers to a std::vector of flash strings.
+	 *
+	 * @param[in] strings Flash strings to refer to.
+	 * @since 3.1.0
+	 */
+	FlashStringArray(const flash_string_vector &strings) : data_(strings.data()), size_(strings.size()) { }
+	/**
+	 * Create an array that refers to a null terminated array of flash
+	 * strings.
+	 *
+	 * @param[in] strings Null terminated array of flash strings to
+	 *                    refer to (or nullptr for an empty array).
+	 * @since 3.1.0
+	 */
+	explicit FlashStringArray(const_iterator strings);
+
+	/**
+	 * Get the number of flash strings in the array.
+	 *
+	 * @return The number of flash strings in the array.
+	 * @since 3.1.0
+	 */
+	inline size_t size() const { return size_; }
+	/**
+	 * Determine if the array is empty.
+	 *
+	 * @return True if there are no flash strings in the array,
+	 *         otherwise false.
+	 * @since 3.1.0
+	 */
+	inline bool empty() const { return size_ == 0; }
+	/**
+	 * Get a flash string from the array.
+	 *
+	 * @param[in] index Position of the flash string in the array.
+	 * @return The flash string at that position.
+	 * @since 3.1.0
+	 */
+	inline value_type operator[](size_t index) const { return data_[index]; }
+
+	/**
+	 * Get an iterator to the first flash string.
+	 *
+	 * @return An iterator to the first flash string.
+	 * @since 3.1.0
+	 */
+	inline const_iterator begin() const { return data_; }
+	/**
+	 * Get an iterator past the last flash string.
+	 *
+	 * @return An iterator past the last flash string.
+	 * @since 3.1.0
+	 */
+	inline const_iterator end() const { return data_ + size_; }
+	/**
+	 * Get an iterator to the first flash string.
+	 *
+	 * @return An iterator to the first flash string.
+	 * @since 3.1.0
+	 */
+	inline const_iterator cbegin() const { return begin(); }
+	/**
+	 * Get an iterator past the last flash string.
+	 *
+	 * @return An iterator past the last flash string.
+	 * @since 3.1.0
+	 */
+	inline const_iterator cend() const { return end(); }
+
+private:
+	const_iterator data_ = nullptr; /*!< First flash string in the array. @since 3.1.0 */
+	size_t size_ = 0; /*!< Number of flash strings in the array. @since 3.1.0 */
+};
+
+/**
+ * Memory arena for temporary allocations.
+ *
+ * Memory is allocated sequentially from a fixed size block, so that
+ * temporary containers can reuse the same memory instead of going
+ * through the heap every time. The whole block becomes available again
+ * when all of the allocations from it have been released. Allocations
+ * that don't fit in the block are made on the heap.
+ *
+ * @since 3.1.0
+ */
+class ScratchArena {
+public:
+	ScratchArena() = default;
+	~ScratchArena() = default;
+
+	/**
+	 * Get the size of the memory block.
+	 *
+	 * @return The size of the memory block in bytes.
+	 * @since 3.1.0
+	 */
+	size_t size() const;
+	/**
+	 * Set the size of the memory block.
+	 *
+	 * If there are any outstanding allocations then the block will be
+	 * reallocated when they have all been released.
+	 *
+	 * Defaults to 0 (all allocations are made on the heap).
+	 *
+	 * @param[in] size The size of the memory block in bytes.
+	 * @since 3.1.0
+	 */
+	void size(size_t size);
+
+	/**
+	 * Allocate memory.
+	 *
+	 * @param[in] size Number of bytes to allocate.
+	 * @param[in] align Alignment of the allocation.
+	 * @return Pointer to the allocated memory.
+	 * @since 3.1.0
+	 */
+	void *allocate(size_t size, size_t align);
+	/**
+	 * Release memory.
+	 *
+	 * The memory can only be reused immediately if it was the most
+	 * recent allocation from the block.
+	 *
+	 * @param[in] ptr Pointer to the allocated memory.
+	 * @param[in] size Number of bytes that were allocated.
+	 * @since 3.1.0
+	 */
+	void deallocate(void *ptr, size_t size);
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+private:
+	std::unique_ptr<uint8_t[]> block_; /*!< Memory block. @since 3.1.0 */
+	size_t size_ = 0; /*!< Size of the memory block in bytes. @since 3.1.0 */
+	size_t requested_size_ = 0; /*!< Size of the memory block to allocate when there are no outstanding allocations. @since 3.1.0 */
+	size_t used_ = 0; /*!< Number of bytes used from the memory block. @since 3.1.0 */
+	size_t allocations_ = 0; /*!< Number of outstanding allocations from the memory block. @since 3.1.0 */
+};
+
+/**
+ * Allocator for containers that uses a ScratchArena.
+ *
+ * @tparam T Type of object to allocate.
+ * @since 3.1.0
+ */
+template<typename T>
+class ScratchAllocator {
+public:
+	using value_type = T; /*!< Type of object to allocate. @since 3.1.0 */
+
+	/**
+	 * Create an allocator that uses the heap.
+	 *
+	 * @since 3.1.0
+	 */
+	ScratchAllocator() noexcept = default;
+	/**
+	 * Create an allocator that uses a memory arena.
+	 *
+	 * @param[in] arena Memory arena to allocate from (nullptr to use
+	 *                  the heap).
+	 * @since 3.1.0
+	 */
+	explicit ScratchAllocator(ScratchArena *arena) noexcept : arena_(arena) {}
+	/**
+	 * Create an allocator that uses the same memory arena as an
+	 * allocator for another type.
+	 *
+	 * @param[in] other Allocator for another type.
+	 * @since 3.1.0
+	 */
+	template<typename U>
+	ScratchAllocator(const ScratchAllocator<U> &other) noexcept : arena_(other.arena()) {}
+
+	/**
+	 * Get the memory arena used by this allocator.
+	 *
+	 * @return The memory arena used by this allocator, or nullptr if
+	 *         it uses the heap.
+	 * @since 3.1.0
+	 */
+	inline ScratchArena *arena() const { return arena_; }
+
+	/**
+	 * Allocate memory for objects.
+	 *
+	 * @param[in] n Number of objects.
+	 * @return Pointer to the allocated memory.
+	 * @since 3.1.0
+	 */
+	T *allocate(size_t n) {
+		if (arena_) {
+			return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+		} else {
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		}
+	}
+	/**
+	 * Release memory for objects.
+	 *
+	 * @param[in] ptr Pointer to the allocated memory.
+	 * @param[in] n Number of objects.
+	 * @since 3.1.0
+	 */
+	void deallocate(T *ptr, size_t n) {
+		if (arena_) {
+			arena_->deallocate(ptr, n * sizeof(T));
+		} else {
+			::operator delete(ptr);
+		}
+	}
+
+	/**
+	 * Compare two allocators for equality.
+	 *
+	 * @param[in] lhs Left-hand side allocator.
+	 * @param[in] rhs Right-hand side allocator.
+	 * @return True if memory allocated by one can be released by the
+	 *         other, otherwise false.
+	 * @since 3.1.0
+	 */
+	friend inline bool operator==(const ScratchAllocator &lhs, const ScratchAllocator &rhs) { return lhs.arena_ == rhs.arena_; }
+	/**
+	 * Compare two allocators for inequality.
+	 *
+	 * @param[in] lhs Left-hand side allocator.
+	 * @param[in] rhs Right-hand side allocator.
+	 * @return True if memory allocated by one can't be released by the
+	 *         other, otherwise false.
+	 * @since 3.1.0
+	 */
+	friend inline bool operator!=(const ScratchAllocator &lhs, const ScratchAllocator &rhs) { return lhs.arena_ != rhs.arena_; }
+
+private:
+	ScratchArena *arena_ = nullptr; /*!< Memory arena to allocate from. @since 3.1.0 */
+};
+
+/**
+ * Fixed capacity buffer for editing a command line.
+ *
+ * Memory for the buffer is only allocated when the capacity is
+ * changed, so editing the command line never needs to use the heap.
+ * Text that doesn't fit in the buffer is truncated.
+ *
+ * If UUID_CONSOLE_LINE_BUFFER_SIZE is defined then the buffer is
+ * stored inline and its capacity is limited to that size.
+ *
+ * @since 3.1.0
+ */
+class LineBuffer {
+public:
+	LineBuffer() = default;
+	~LineBuffer() = default;
+
+	/**
+	 * Get the maximum length of the text in the buffer.
+	 *
+	 * @return The maximum length of the text in bytes.
+	 * @since 3.1.0
+	 */
+	inline size_t capacity() const { return capacity_; }
+	/**
+	 * Set the maximum length of the text in the buffer.
+	 *
+	 * Existing text that is longer than the new capacity is truncated.
+	 *
+	 * @param[in] capacity The maximum length of the text in bytes
+	 *                     (limited to UUID_CONSOLE_LINE_BUFFER_SIZE
+	 *                     if it is defined).
+	 * @since 3.1.0
+	 */
+	void capacity(size_t capacity);
+
+	/**
+	 * Get the text in the buffer.
+	 *
+	 * @return The text in the buffer, terminated with a null
+	 *         character.
+	 * @since 3.1.0
+	 */
+	inline const char *c_str() const { return capacity_ > 0 ? &data_[0] : ""; }
+	/**
+	 * Get the length of the text in the buffer.
+	 *
+	 * @return The length of the text in bytes.
+	 * @since 3.1.0
+	 */
+	inline size_t length() const { return length_; }
+	/**
+	 * Determine if the buffer is empty.
+	 *
+	 * @return True if there is no text in the buffer, otherwise false.
+	 * @since 3.1.0
+	 */
+	inline bool empty() const { return length_ == 0; }
+	/**
+	 * Get the text in the buffer as a string.
+	 *
+	 * @return A copy of the text in the buffer.
+	 * @since 3.1.0
+	 */
+	inline std::string str() const { return std::string(c_str(), length_); }
+
+	/**
+	 * Append a character to the end of the text.
+	 *
+	 * @param[in] c Character to append.
+	 * @return True if the character was appended, false if the buffer
+	 *         is full.
+	 * @since 3.1.0
+	 */
+	bool push_back(char c);
+	/**
+	 * Remove the last character from the text, if there is one.
+	 *
+	 * @since 3.1.0
+	 */
+	void pop_back();
+	/**
+	 * Remove all of the text.
+	 *
+	 * @since 3.1.0
+	 */
+	void clear();
+	/**
+	 * Truncate the text.
+	 *
+	 * @param[in] length New length of the text in bytes. Has no effect
+	 *                   if it is not shorter than the current length.
+	 * @since 3.1.0
+	 */
+	void resize(size_t length);
+	/**
+	 * Replace the text.
+	 *
+	 * @param[in] text New text.
+	 * @param[in] length Length of the new text in bytes.
+	 * @since 3.1.0
+	 */
+	void assign(const char *text, size_t length);
+	/**
+	 * Find the last occurrence of a character in the text.
+	 *
+	 * @param[in] c Character to find.
+	 * @return The position of the character, or std::string::npos if
+	 *         it was not found.
+	 * @since 3.1.0
+	 */
+	size_t find_last_of(char c) const;
+
+	LineBuffer(const LineBuffer&) = delete;
+	LineBuffer& operator=(const LineBuffer&) = delete;
+
+private:
+#if UUID_CONSOLE_LINE_BUFFER_SIZE > 0
+	char data_[UUID_CONSOLE_LINE_BUFFER_SIZE + 1] = {}; /*!< Text in the buffer, terminated with a null character. @since 3.1.0 */
+#else
+	std::unique_ptr<char[]> data_; /*!< Text in the buffer, terminated with a null character. @since 3.1.0 */
+#endif
+	size_t capacity_ = 0; /*!< Maximum length of the text in bytes. @since 3.1.0 */
+	size_t length_ = 0; /*!< Length of the text in bytes. @since 3.1.0 */
+};
 
 /**
  * Container of commands for use by a Shell.
  *
  * These should normally be stored in a std::shared_ptr and reused.
  *
+ * Commands that are added while a command is being executed are only
+ * available after it returns, because the commands are stored
+ * contiguously and must not move while they are in use.
+ *
  * @since 0.1.0
  */
 class Commands {
@@ -93,6 +504,7 @@ private:
 
 public:
 	struct Completion;
+	struct CompletionCache;
 
 	/**
 	 * Result of a command execution operation.
@@ -131,9 +543,169 @@ public:
 	using argument_completion_function = std::function<const std::vector<std::string>(
 		Shell &shell, const std::vector<std::string> &current_arguments, const std::string &next_argument)>;
 
+	/**
+	 * Potential values for the next argument on the command line,
+	 * provided one at a time by an argument completion stream function.
+	 *
+	 * Values that don't start with the argument being completed are
+	 * discarded immediately. Only the values that will be shown are
+	 * kept, and only the longest common prefix of the rest is tracked.
+	 *
+	 * @since 3.1.0
+	 */
+	class ArgumentCompletions {
+	public:
+		/**
+		 * Create an empty list of potential values for an argument.
+		 *
+		 * @param[in] next_argument Argument being completed, which must
+		 *                          remain valid for the lifetime of this
+		 *                          object.
+		 * @param[in] limit Maximum number of values to keep (0 for no
+		 *                  limit).
+		 * @since 3.1.0
+		 */
+		ArgumentCompletions(const std::string &next_argument, size_t limit);
+		~ArgumentCompletions() = default;
+
+		/**
+		 * Add a potential value for the argument.
+		 *
+		 * @param[in] value Potential value for the argument.
+		 * @return True if more values could change the result of the
+		 *         completion, false if the function providing values
+		 *         can stop.
+		 * @since 3.1.0
+		 */
+		bool add(std::string value);
+
+		/**
+		 * Get the number of values that start with the argument being
+		 * completed.
+		 *
+		 * This may not include all of the values if they stopped being
+		 * added when add() returned false.
+		 *
+		 * @return The number of matching values that were added.
+		 * @since 3.1.0
+		 */
+		inline size_t count() const { return count_; }
+		/**
+		 * Get the longest common prefix of all the matching values.
+		 *
+		 * @return The longest common prefix of all the values that
+		 *         start with the argument being completed.
+		 * @since 3.1.0
+		 */
+		inline const std::string &common_prefix() const { return common_prefix_; }
+		/**
+		 * Get the matching values that have been kept.
+		 *
+		 * @return The first matching values up to the limit, in the
+		 *         order they were added.
+		 * @since 3.1.0
+		 */
+		inline std::vector<std::string> &values() { return values_; }
+		/**
+		 * Determine if all of the matching values have been kept.
+		 *
+		 * @return True if every value was added and kept, otherwise
+		 *         false.
+		 * @since 3.1.0
+		 */
+		inline bool complete() const { return complete_ && count_ == values_.size(); }
+
+	private:
+		const std::string &next_argument_; /*!< Argument being completed. @since 3.1.0 */
+		const size_t limit_; /*!< Maximum number of values to keep (0 for no limit). @since 3.1.0 */
+		size_t count_ = 0; /*!< Number of matching values that were added. @since 3.1.0 */
+		bool complete_ = true; /*!< add() has not returned false. @since 3.1.0 */
+		std::string common_prefix_; /*!< Longest common prefix of the matching values. @since 3.1.0 */
+		std::vector<std::string> values_; /*!< Matching values that have been kept. @since 3.1.0 */
+	};
+
+	/**
+	 * Function to provide completions for a command line one at a time.
+	 *
+	 * The function should add potential values for the next argument
+	 * to the list of completions until there are no more or
+	 * ArgumentCompletions::add() returns false. Values can be filtered
+	 * by the function using next_argument, otherwise they are filtered
+	 * as they are added.
+	 *
+	 * @param[in] shell Shell instance that has a command line matching
+	 *                  this command.
+	 * @param[in] current_arguments Command line arguments prior to (but
+	 *                              excluding) the argument being
+	 *                              completed.
+	 * @param[in] next_argument Next argument (the one being completed).
+	 * @param[in,out] completions Potential values for the next argument
+	 *                            on the command line.
+	 * @since 3.1.0
+	 */
+	using argument_completion_stream_function = std::function<void(
+		Shell &shell, const std::vector<std::string> &current_arguments, const std::string &next_argument,
+		ArgumentCompletions &completions)>;
+
+	/**
+	 * Function to handle a command from a static command table.
+	 *
+	 * @param[in] shell Shell instance that is executing the command.
+	 * @param[in] arguments Command line arguments.
+	 * @since 3.1.0
+	 */
+	using static_command_function = void (*)(Shell &shell, std::vector<std::string> &arguments);
+
+	/**
+	 * Function to obtain completions for a command line from a static
+	 * command table.
+	 *
+	 * @param[in] shell Shell instance that has a command line matching
+	 *                  this command.
+	 * @param[in] current_arguments Command line arguments prior to (but
+	 *                              excluding) the argument being
+	 *                              completed.
+	 * @param[in] next_argument Next argument (the one being completed).
+	 * @return Possible values for the next argument on the command
+	 *         line.
+	 * @since 3.1.0
+	 */
+	using static_argument_completion_function = const std::vector<std::string> (*)(
+		Shell &shell, const std::vector<std::string> &current_arguments, const std::string &next_argument);
+
+	/**
+	 * Command in a static command table.
+	 *
+	 * Tables of these can be declared as constant data (in PROGMEM) and
+	 * added to a container without copying the names or arguments.
+	 * The name and arguments are null terminated arrays of flash
+	 * strings. The table and arrays must remain valid for as long as
+	 * the container.
+	 *
+	 * The table is read directly, so it must be in memory that can be
+	 * read with aligned loads (which includes PROGMEM on ESP8266 and
+	 * ESP32).
+	 *
+	 * @since 3.1.0
+	 */
+	struct StaticCommand {
+		unsigned int context; /*!< Shell context in which this command is available. @since 3.1.0 */
+		unsigned int flags; /*!< Shell flags that must be set for this command to be available. @since 3.1.0 */
+		unsigned int not_flags; /*!< Shell flags that must not be set for this command to be available. @since 3.1.0 */
+		const __FlashStringHelper * const *name; /*!< Name of the command as a null terminated array of flash strings. @since 3.1.0 */
+		const __FlashStringHelper * const *arguments; /*!< Help text for arguments that the command accepts as a null terminated array of flash strings (or nullptr if there are no arguments). @since 3.1.0 */
+		static_command_function function; /*!< Function to be used when the command is executed. @since 3.1.0 */
+		static_argument_completion_function arg_function; /*!< Function to be used to perform argument completions for this command (or nullptr). @since 3.1.0 */
+	};
+
+	class AvailableCommands;
+
 	/**
 	 * Available command for execution on a Shell.
 	 *
+	 * The name and arguments are only copied from flash strings when
+	 * they are accessed as std::vector of strings.
+	 *
 	 * @since 0.9.0
 	 */
 	class AvailableCommand {
@@ -151,7 +723,15 @@ public:
 		 * @return Name of the command as a std::vector of strings.
 		 * @since 0.9.0
 		 */
-		inline const std::vector<std::string> &name() const { return name_; }
+		const std::vector<std::string> &name() const;
+
+		/**
+		 * Get the name of the command without copying it.
+		 *
+		 * @return Name of the command as an array of flash strings.
+		 * @since 3.1.0
+		 */
+		inline FlashStringArray flash_name() const { return command_->name_; }
 
 		/**
 		 * Get the help text of the command's arguments.
@@ -159,7 +739,16 @@ public:
 		 * @return Help text for arguments that the command accepts as a std::vector of strings.
 		 * @since 0.9.0
 		 */
-		inline const std::vector<std::string> &arguments() const { return arguments_; }
+		const std::vector<std::string> &arguments() const;
+
+		/**
+		 * Get the help text of the command's arguments without
+		 * copying it.
+		 *
+		 * @return Help text for arguments that the command accepts as an array of flash strings.
+		 * @since 3.1.0
+		 */
+		inline FlashStringArray flash_arguments() const { return command_->arguments_; }
 
 		/**
 		 * Get the function to be used when the command is executed.
@@ -167,7 +756,7 @@ public:
 		 * @return Function that can be used to execute the command.
 		 * @since 0.9.0
 		 */
-		inline const command_function &function() const { return command_.function_; };
+		inline const command_function &function() const { return command_->function_; };
 
 		/**
 		 * Get the function to be used to perform argument completions for the command.
@@ -175,7 +764,30 @@ public:
 		 * @return Function that can be used to perform argument completions for the command.
 		 * @since 0.9.0
 		 */
-		inline const argument_completion_function &arg_function() const { return command_.arg_function_; };
+		inline const argument_completion_function &arg_function() const { return command_->arg_function_; };
+
+#if UUID_CONSOLE_STATISTICS
+		/**
+		 * Get the number of times the command has been executed.
+		 *
+		 * Only available if UUID_CONSOLE_STATISTICS is enabled.
+		 *
+		 * @return Number of times the command has been executed.
+		 * @since 3.1.0
+		 */
+		inline unsigned long executions() const { return command_->executions_.load(); }
+
+		/**
+		 * Get the total time spent executing the command.
+		 *
+		 * Only available if UUID_CONSOLE_STATISTICS is enabled.
+		 *
+		 * @return Total time spent executing the command, in
+		 *         microseconds.
+		 * @since 3.1.0
+		 */
+		inline uint64_t execution_time() const { return command_->execution_time_.load(); }
+#endif
 
 		/**
 		 * Get the shell flags that must be set for this command to be available.
@@ -183,7 +795,7 @@ public:
 		 * @return Shell flags.
 		 * @since 0.9.0
 		 */
-		inline int flags() const { return command_.flags_; }
+		inline int flags() const { return command_->flags_; }
 
 		/**
 		 * Get the shell flags that must not be set for this command to be available.
@@ -191,12 +803,22 @@ public:
 		 * @return Shell flags.
 		 * @since 0.9.0
 		 */
-		inline int not_flags() const { return command_.not_flags_; }
+		inline int not_flags() const { return command_->not_flags_; }
 
 	private:
-		const Commands::Command &command_; /*!< Command that is available. @since 0.9.0 */
-		std::vector<std::string> name_; /*!< Name of the command. @since 0.9.0 */
-		std::vector<std::string> arguments_; /*!< Help text for arguments that the command accepts. @since 0.9.0 */
+		friend AvailableCommands;
+
+		/**
+		 * Construct an empty placeholder for a command that is
+		 * available for execution on a Shell.
+		 *
+		 * @since 3.1.0
+		 */
+		AvailableCommand() = default;
+
+		const Commands::Command *command_ = nullptr; /*!< Command that is available. @since 0.9.0 */
+		mutable std::vector<std::string> name_; /*!< Name of the command, copied when first accessed. @since 0.9.0 */
+		mutable std::vector<std::string> arguments_; /*!< Help text for arguments that the command accepts, copied when first accessed. @since 0.9.0 */
 	};
 
 	/**
@@ -209,7 +831,7 @@ public:
 	 */
 	class AvailableCommands {
 	public:
-		using command_iterator = std::multimap<unsigned int,Command>::const_iterator; /*!< Type of the underlying command iterator. @since 0.9.0 */
+		using command_iterator = std::vector<std::pair<unsigned int,Command>>::const_iterator; /*!< Type of the underlying command iterator. @since 0.9.0 */
 
 		/**
 		 * Iterator of available commands for execution on a Shell.
@@ -248,7 +870,7 @@ public:
 			 *          this position exists.
 			 * @since 0.9.0
 			 */
-			inline reference operator*() const { return *available_command_; }
+			inline reference operator*() const { return available_command_; }
 			/**
 			 * Access the current available command.
 			 *
@@ -257,7 +879,7 @@ public:
 			 *          this position exists.
 			 * @since 0.9.0
 			 */
-			inline pointer operator->() const { return available_command_.get(); }
+			inline pointer operator->() const { return &available_command_; }
 
 			/**
 			 * Pre-increment the current iterator to the next
@@ -326,7 +948,7 @@ public:
 			const command_iterator begin_; /*!< Beginning of command iterators. @since 0.9.0 */
 			command_iterator command_; /*!< Current command iterator. @since 0.9.0 */
 			const command_iterator end_; /*!< End of command iterators. @since 0.9.0 */
-			std::shared_ptr<AvailableCommand> available_command_; /*!< Current available command. @since 0.9.0 */
+			AvailableCommand available_command_; /*!< Current available command. @since 0.9.0 */
 		};
 
 		/**
@@ -616,6 +1238,81 @@ public:
 	void add_command(unsigned int context, unsigned int flags, unsigned int not_flags,
 			const flash_string_vector &name, const flash_string_vector &arguments,
 			command_function function, argument_completion_function arg_function);
+	/**
+	 * Add a command with arguments and automatic argument completion
+	 * (providing values one at a time) to the list of commands in this
+	 * container.
+	 *
+	 * @param[in] context Shell context in which this command is
+	 *                    available.
+	 * @param[in] flags Shell flags that must be set for this command
+	 *                  to be available.
+	 * @param[in] not_flags Shell flags that must not be set for this command
+	 *                      to be available.
+	 * @param[in] name Name of the command as a std::vector of flash
+	 *                 strings.
+	 * @param[in] arguments Help text for arguments that the command
+	 *                      accepts as a std::vector of flash strings
+	 *                      (use "<" to indicate a required argument).
+	 * @param[in] function Function to be used when the command is
+	 *                     executed.
+	 * @param[in] arg_function Function to be used to provide argument
+	 *                         completions for this command.
+	 * @since 3.1.0
+	 */
+	void add_command(unsigned int context, unsigned int flags, unsigned int not_flags,
+			const flash_string_vector &name, const flash_string_vector &arguments,
+			command_function function, argument_completion_stream_function arg_function);
+	/**
+	 * Add a command with arguments and no argument completion to the
+	 * list of commands in this container.
+	 *
+	 * @param[in] context Shell context in which this command is
+	 *                    available.
+	 * @param[in] flags Shell flags that must be set for this command
+	 *                  to be available.
+	 * @param[in] not_flags Shell flags that must not be set for this command
+	 *                      to be available.
+	 * @param[in] name Name of the command as a std::vector of flash
+	 *                 strings.
+	 * @param[in] arguments Help text for arguments that the command
+	 *                      accepts as a std::vector of flash strings
+	 *                      (use "<" to indicate a required argument).
+	 * @param[in] function Function to be used when the command is
+	 *                     executed.
+	 * @param[in] arg_function No argument completion function.
+	 * @since 3.1.0
+	 */
+	void add_command(unsigned int context, unsigned int flags, unsigned int not_flags,
+			const flash_string_vector &name, const flash_string_vector &arguments,
+			command_function function, std::nullptr_t arg_function);
+
+	/**
+	 * Add commands from a static command table to the list of commands
+	 * in this container.
+	 *
+	 * The names and arguments of the commands are not copied and no
+	 * memory is allocated for each command other than its entry in the
+	 * list of commands. The table can be mixed with commands that are
+	 * added individually.
+	 *
+	 * @param[in] commands Static command table, which must remain
+	 *                     valid for as long as this container.
+	 * @param[in] count Number of commands in the table.
+	 * @since 3.1.0
+	 */
+	void add_commands(const StaticCommand *commands, size_t count);
+	/**
+	 * Add commands from a static command table to the list of commands
+	 * in this container.
+	 *
+	 * @tparam N Number of commands in the table.
+	 * @param[in] commands Static command table, which must remain
+	 *                     valid for as long as this container.
+	 * @since 3.1.0
+	 */
+	template <size_t N>
+	inline void add_commands(const StaticCommand (&commands)[N]) { add_commands(commands, N); }
 
 	/**
 	 * Execute a command for a Shell if it exists in the current
@@ -640,6 +1337,30 @@ public:
 	 * @since 0.1.0
 	 */
 	Completion complete_command(Shell &shell, const CommandLine &command_line);
+	/**
+	 * Complete a partial command for a Shell if it exists in the
+	 * current context and with the current flags, reusing the result
+	 * of the previous completion if the command line extends it.
+	 *
+	 * When the command line extends the previous command line, only
+	 * the commands that matched previously are checked again. When
+	 * the argument being completed extends the previous argument, the
+	 * previous potential values are filtered again instead of calling
+	 * the argument completion function.
+	 *
+	 * The cache must be cleared if the context or flags of the shell
+	 * change, or if the values returned by argument completion
+	 * functions (for the same arguments) may change.
+	 *
+	 * @param[in] shell Shell that is completing the command.
+	 * @param[in] command_line Command line parameters.
+	 * @param[in,out] cache Cache of the previous completion for this
+	 *                      shell (or nullptr for no cache).
+	 * @return An object describing the result of the command
+	 *         completion operation.
+	 * @since 3.1.0
+	 */
+	Completion complete_command(Shell &shell, const CommandLine &command_line, CompletionCache *cache);
 
 	/**
 	 * Get the available commands in the current context and with the
@@ -654,7 +1375,70 @@ public:
 	 */
 	AvailableCommands available_commands(const Shell &shell) const;
 
+	/**
+	 * Build an index of the command names so that commands can be
+	 * found without checking every command in the current context.
+	 *
+	 * This should be called after all of the commands have been added.
+	 * The index uses additional memory and it will be discarded if any
+	 * more commands are added.
+	 *
+	 * @since 3.1.0
+	 */
+	void build_index();
+
+	/**
+	 * Release any unused memory that was reserved for storing the
+	 * commands.
+	 *
+	 * This should be called after all of the commands have been added.
+	 * It has no effect while a command is being executed.
+	 *
+	 * @since 3.1.0
+	 */
+	void compact();
+
 private:
+#if UUID_CONSOLE_STATISTICS
+	/**
+	 * Statistics counter that can be updated by shells in different
+	 * tasks (if thread-safe operation is enabled) and moved with the
+	 * command that it belongs to.
+	 *
+	 * @tparam T Type of the value.
+	 * @since 3.1.0
+	 */
+	template <typename T>
+	class Counter {
+	public:
+		Counter() = default;
+		Counter(Counter &&other) : value_(other.load()) {} /*!< Move constructor, used when the command storage is rearranged. @since 3.1.0 */
+		Counter& operator=(Counter &&other) { value_ = other.load(); return *this; } /*!< Move assignment operator, used when the command storage is rearranged. @since 3.1.0 */
+
+		/**
+		 * Get the current value.
+		 *
+		 * @return The current value of the counter.
+		 * @since 3.1.0
+		 */
+		inline T load() const { return value_; }
+		/**
+		 * Add to the value.
+		 *
+		 * @param[in] value Amount to add to the counter.
+		 * @since 3.1.0
+		 */
+		inline void add(T value) { value_ += value; }
+
+	private:
+#if UUID_CONSOLE_THREAD_SAFE
+		std::atomic<T> value_{0}; /*!< Current value of the counter. @since 3.1.0 */
+#else
+		T value_ = 0; /*!< Current value of the counter. @since 3.1.0 */
+#endif
+	};
+#endif
+
 	/**
 	 * Command for execution on a Shell.
 	 * @since 0.1.0
@@ -682,8 +1466,19 @@ private:
 		Command(unsigned int flags, unsigned int not_flags,
 				const flash_string_vector name, const flash_string_vector arguments,
 				command_function function, argument_completion_function arg_function);
+		/**
+		 * Create a command for execution on a Shell from a static
+		 * command table.
+		 *
+		 * @param[in] command Command in a static command table.
+		 * @since 3.1.0
+		 */
+		explicit Command(const StaticCommand &command);
 		~Command();
 
+		Command(Command&&) = default; /*!< Move constructor, used when the command storage is rearranged. @since 3.1.0 */
+		Command& operator=(Command&&) = default; /*!< Move assignment operator, used when the command storage is rearranged. @since 3.1.0 */
+
 		/**
 		 * Determine the minimum number of arguments for this command
 		 * based on the help text for the arguments that begin with the
@@ -704,10 +1499,17 @@ private:
 
 		unsigned int flags_; /*!< Shell flags that must be set for this command to be available. @since 0.1.0 */
 		unsigned int not_flags_; /*!< Shell flags that must not be set for this command to be available. @since 0.8.0 */
-		const flash_string_vector name_; /*!< Name of the command as a std::vector of flash strings. @since 0.1.0 */
-		const flash_string_vector arguments_; /*!< Help text for arguments that the command accepts as a std::vector of flash strings. @since 0.1.0 */
+		flash_string_vector name_vector_; /*!< Name of the command as a std::vector of flash strings (unless it's from a static command table). @since 3.1.0 */
+		flash_string_vector arguments_vector_; /*!< Help text for arguments that the command accepts as a std::vector of flash strings (unless it's from a static command table). @since 3.1.0 */
+		FlashStringArray name_; /*!< Name of the command as an array of flash strings. @since 0.1.0 */
+		FlashStringArray arguments_; /*!< Help text for arguments that the command accepts as an array of flash strings. @since 0.1.0 */
 		command_function function_; /*!< Function to be used when the command is executed. @since 0.1.0 */
 		argument_completion_function arg_function_; /*!< Function to be used to perform argument completions for this command. @since 0.1.0 */
+		argument_completion_stream_function arg_stream_function_; /*!< Function to be used to provide argument completions for this command one at a time. @since 3.1.0 */
+#if UUID_CONSOLE_STATISTICS
+		mutable Counter<unsigned long> executions_; /*!< Number of times the command has been executed. @since 3.1.0 */
+		mutable Counter<uint64_t> execution_time_; /*!< Total time spent executing the command, in microseconds. @since 3.1.0 */
+#endif
 
 	private:
 		Command(const Command&) = delete;
@@ -715,27 +1517,162 @@ private:
 	};
 
 	/**
-	 * Result of a command find operation.
+	 * Result of a command find operation.
+	 *
+	 * Each matching command is returned in a map grouped by size.
+	 * @since 0.1.0
+	 */
+	struct Match {
+		using command_map = std::multimap<size_t,const Command*,std::less<size_t>,ScratchAllocator<std::pair<const size_t,const Command*>>>; /*!< Type of commands grouped by the size of the command names. @since 3.1.0 */
+
+		/**
+		 * Create an empty result of a command find operation.
+		 *
+		 * @param[in] arena Memory arena to use for the result (nullptr
+		 *                  to use the heap).
+		 * @since 3.1.0
+		 */
+		explicit Match(ScratchArena *arena = nullptr)
+				: exact(std::less<size_t>{}, command_map::allocator_type{arena}),
+				  partial(std::less<size_t>{}, command_map::allocator_type{arena}),
+				  all(ScratchAllocator<const Command*>{arena}) {
+		}
+
+		command_map exact; /*!< Commands that match the command line exactly, grouped by the size of the command names. @since 0.1.0 */
+		command_map partial; /*!< Commands that the command line partially matches, grouped by the size of the command names. @since 0.1.0 */
+		std::vector<const Command*,ScratchAllocator<const Command*>> all; /*!< Commands that match the command line, in defined order. @since 0.7.6 */
+	};
+
+	/**
+	 * Node in the index of command names.
+	 *
+	 * @since 3.1.0
+	 */
+	struct IndexNode {
+		const __FlashStringHelper *name; /*!< Name component for this node (nullptr for the root node). @since 3.1.0 */
+		unsigned int flags; /*!< Shell flags that must be set for any of the commands at or below this node to be available. @since 3.1.0 */
+		unsigned int not_flags; /*!< Shell flags that must not be set for any of the commands at or below this node to be available. @since 3.1.0 */
+		std::vector<size_t> commands; /*!< Commands with a name that ends at this node, as positions in Index::commands. @since 3.1.0 */
+		std::vector<size_t> children; /*!< Nodes for the next name component, as positions in Index::nodes. @since 3.1.0 */
+	};
+
+	using IndexMatches = std::vector<std::pair<size_t,bool>,ScratchAllocator<std::pair<size_t,bool>>>; /*!< Positions of matching commands in the index of command names, and whether they are an exact match. @since 3.1.0 */
+
+	/**
+	 * Index of command names in one context.
+	 *
+	 * @since 3.1.0
+	 */
+	struct Index {
+		std::vector<const Command*> commands; /*!< Commands in this context, in defined order. @since 3.1.0 */
+		std::vector<IndexNode> nodes; /*!< Prefix tree of command name components, starting with the root node. @since 3.1.0 */
+	};
+
+	/**
+	 * Complete a partial command for a Shell, without measuring the
+	 * time taken.
+	 *
+	 * @param[in] shell Shell that is completing the command.
+	 * @param[in] command_line Command line parameters.
+	 * @param[in,out] cache Cache of the previous completion for this
+	 *                      shell (or nullptr for no cache).
+	 * @return An object describing the result of the command
+	 *         completion operation.
+	 * @since 3.1.0
+	 */
+	Completion complete_matching_command(Shell &shell, const CommandLine &command_line, CompletionCache *cache);
+
+	/**
+	 * Find commands by matching them against the command line.
+	 *
+	 * @param[in] shell Shell that is accessing commands.
+	 * @param[in] command_line Command line parameters.
+	 * @return An object describing the result of the command find
+	 *         operation.
+	 * @since 0.1.0
+	 */
+	Match find_command(Shell &shell, const CommandLine &command_line);
+	/**
+	 * Find commands by matching some of the commands against the
+	 * command line.
+	 *
+	 * @param[in] shell Shell that is accessing commands.
+	 * @param[in] command_line Command line parameters.
+	 * @param[in] candidates Commands to check, in the order that they
+	 *                       were defined.
+	 * @return An object describing the result of the command find
+	 *         operation.
+	 * @since 3.1.0
+	 */
+	static Match find_command(Shell &shell, const CommandLine &command_line, const std::vector<const Command*> &candidates);
+	/**
+	 * Match a command against the command line and add it to the
+	 * result of a command find operation if it matches.
 	 *
-	 * Each matching command is returned in a map grouped by size.
-	 * @since 0.1.0
+	 * @param[in,out] commands Result of the command find operation.
+	 * @param[in] command Command to match.
+	 * @param[in] command_line Command line parameters.
+	 * @since 3.1.0
 	 */
-	struct Match {
-		std::multimap<size_t,const Command*> exact; /*!< Commands that match the command line exactly, grouped by the size of the command names. @since 0.1.0 */
-		std::multimap<size_t,const Command*> partial; /*!< Commands that the command line partially matches, grouped by the size of the command names. @since 0.1.0 */
-		std::vector<const Command*> all; /*!< Commands that match the command line, in defined order. @since 0.7.6 */
-	};
+	static void match_command(Match &commands, const Command &command, const CommandLine &command_line);
+	/**
+	 * Determine if a command line extends a previous command line such
+	 * that every command matching it also matched the previous command
+	 * line.
+	 *
+	 * @param[in] previous Parameters of the previous command line.
+	 * @param[in] previous_trailing_space The previous command line had
+	 *                                    a trailing space.
+	 * @param[in] current Current command line.
+	 * @return True if the current command line extends the previous
+	 *         command line, otherwise false.
+	 * @since 3.1.0
+	 */
+	static bool extends_command_line(const std::vector<std::string> &previous, bool previous_trailing_space, const CommandLine &current);
 
 	/**
-	 * Find commands by matching them against the command line.
+	 * Find commands by matching them against the command line using
+	 * the index of command names.
 	 *
 	 * @param[in] shell Shell that is accessing commands.
+	 * @param[in] index Index of command names in the shell's context.
 	 * @param[in] command_line Command line parameters.
 	 * @return An object describing the result of the command find
 	 *         operation.
-	 * @since 0.1.0
+	 * @since 3.1.0
 	 */
-	Match find_command(Shell &shell, const CommandLine &command_line);
+	static Match find_indexed_command(Shell &shell, const Index &index, const CommandLine &command_line);
+
+	/**
+	 * Find commands at or below a node in the index of command names
+	 * that match the remainder of the command line.
+	 *
+	 * @param[in] shell Shell that is accessing commands.
+	 * @param[in] index Index of command names in the shell's context.
+	 * @param[in] node Position of the node in the index.
+	 * @param[in] depth Number of command line parameters that match
+	 *                  exactly to reach this node.
+	 * @param[in] command_line Command line parameters.
+	 * @param[out] found Positions of matching commands in the index,
+	 *                   and whether they are an exact match.
+	 * @since 3.1.0
+	 */
+	static void find_indexed_command(Shell &shell, const Index &index, size_t node, size_t depth,
+			const CommandLine &command_line, IndexMatches &found);
+
+	/**
+	 * Add all of the available commands at or below a node in the
+	 * index of command names as partial matches.
+	 *
+	 * @param[in] shell Shell that is accessing commands.
+	 * @param[in] index Index of command names in the shell's context.
+	 * @param[in] node Position of the node in the index.
+	 * @param[out] found Positions of matching commands in the index,
+	 *                   and whether they are an exact match.
+	 * @since 3.1.0
+	 */
+	static void find_indexed_partial_commands(Shell &shell, const Index &index, size_t node,
+			IndexMatches &found);
 
 	/**
 	 * Find the longest common prefix from a shortest match of commands.
@@ -748,18 +1685,82 @@ private:
 	 *          a partial component.
 	 * @since 0.1.0
 	 */
-	static bool find_longest_common_prefix(const std::multimap<size_t,const Command*> &commands, std::vector<std::string> &longest_name);
+	static bool find_longest_common_prefix(const Match::command_map &commands, std::vector<std::string> &longest_name);
 
 	/**
-	 * Find the longest common prefix from a list of potential arguments.
+	 * Check if a flash string is equal to a string, without copying
+	 * the flash string.
 	 *
-	 * @param[in] arguments All potential arguments (at least 2).
-	 * @return The longest common prefix, which could be empty.
-	 * @since 0.1.0
+	 * @param[in] str Flash string to compare.
+	 * @param[in] text String to compare.
+	 * @return True if the strings are equal, otherwise false.
+	 * @since 3.1.0
+	 */
+	static bool flash_string_equal(const __FlashStringHelper *str, const std::string &text);
+
+	/**
+	 * Check if two flash strings are equal, without copying them.
+	 *
+	 * @param[in] str1 First flash string to compare.
+	 * @param[in] str2 Second flash string to compare.
+	 * @return True if the strings are equal, otherwise false.
+	 * @since 3.1.0
 	 */
-	static std::string find_longest_common_prefix(const std::vector<std::string> &arguments);
+	static bool flash_string_equal(const __FlashStringHelper *str1, const __FlashStringHelper *str2);
 
-	std::multimap<unsigned int,Command> commands_; /*!< Commands stored in this container, separated by context. @since 0.1.0 */
+	/**
+	 * Check if a flash string starts with a prefix, without copying
+	 * the flash string.
+	 *
+	 * @param[in] str Flash string to check.
+	 * @param[in] prefix Prefix to find at the start of the flash
+	 *                   string.
+	 * @return True if the flash string starts with (or is equal to)
+	 *         the prefix, otherwise false.
+	 * @since 3.1.0
+	 */
+	static bool flash_string_starts_with(const __FlashStringHelper *str, const std::string &prefix);
+
+	/**
+	 * Insert a command into the list of commands in this container,
+	 * after the existing commands in the same context.
+	 *
+	 * If a command is being executed, the command is inserted when it
+	 * returns.
+	 *
+	 * @param[in] context Shell context in which this command is
+	 *                    available.
+	 * @param[in] command Command to insert.
+	 * @since 3.1.0
+	 */
+	void insert_command(unsigned int context, Command &&command);
+	/**
+	 * Insert the commands that were added while a command was being
+	 * executed.
+	 *
+	 * @since 3.1.0
+	 */
+	void insert_pending_commands();
+
+	/**
+	 * Find the commands for a context.
+	 *
+	 * @param[in] context Shell context to find commands for.
+	 * @return The range of commands for the context.
+	 * @since 3.1.0
+	 */
+	std::pair<AvailableCommands::command_iterator,AvailableCommands::command_iterator> context_commands(unsigned int context) const;
+
+	std::vector<std::pair<unsigned int,Command>> commands_; /*!< Commands stored in this container, sorted by context in the order they were added. @since 0.1.0 */
+	std::map<unsigned int,Index> index_; /*!< Index of command names, separated by context. @since 3.1.0 */
+	bool indexed_ = false; /*!< The index of command names has been built and is up to date. @since 3.1.0 */
+	unsigned long revision_ = 0; /*!< Number of times the commands have been changed, to detect completion caches that refer to old commands. @since 3.1.0 */
+	std::vector<std::pair<unsigned int,Command>> pending_commands_; /*!< Commands added while a command was being executed, to be stored when it returns. @since 3.1.0 */
+#if UUID_CONSOLE_THREAD_SAFE
+	std::atomic<unsigned int> executing_{0}; /*!< Number of commands currently being executed. @since 3.1.0 */
+#else
+	unsigned int executing_ = 0; /*!< Number of commands currently being executed. @since 3.1.0 */
+#endif
 };
 
 /**
@@ -773,6 +1774,7 @@ class Shell: public std::enable_shared_from_this<Shell>, public uuid::log::Handl
 public:
 	static constexpr size_t MAX_COMMAND_LINE_LENGTH = 80; /*!< Maximum length of a command line. @since 0.1.0 */
 	static constexpr size_t MAX_LOG_MESSAGES = 20; /*!< Maximum number of log messages to buffer before they are output. @since 0.1.0 */
+	static constexpr size_t MAX_INPUT_BATCH = 1; /*!< Maximum number of input characters to process in one loop. @since 3.1.0 */
 
 	/**
 	 * Function to handle the response to a password entry prompt.
@@ -804,6 +1806,171 @@ public:
 	 * @since 0.2.0
 	 */
 	using blocking_function = std::function<bool(Shell &shell, bool stop)>;
+	/**
+	 * Function to produce the next chunk of output.
+	 *
+	 * @param[in] shell Shell instance where output is being produced.
+	 * @param[in] available The number of bytes that can be written to
+	 *                      the shell without waiting.
+	 * @return True if all of the output has been produced, otherwise
+	 *         false.
+	 * @since 3.1.0
+	 */
+	using output_function = std::function<bool(Shell &shell, size_t available)>;
+
+	class Group;
+	class SharedLogQueue;
+
+	/**
+	 * Resumable task to be executed on a shell instead of normal
+	 * command execution.
+	 *
+	 * Each call to resume() continues from where the previous call
+	 * returned (e.g. using a state member variable) and returns the
+	 * condition to wait for before it is resumed again. The task is
+	 * only allocated once when it is started, so waiting for input, a
+	 * delay or space to output more data doesn't call a function or
+	 * allocate memory for each step.
+	 *
+	 * @since 3.1.0
+	 */
+	class Task {
+	public:
+		/**
+		 * Condition that a task is waiting for before it is resumed.
+		 *
+		 * @since 3.1.0
+		 */
+		class Wait {
+		public:
+			/**
+			 * The task has finished.
+			 *
+			 * @return Condition to finish the task.
+			 * @since 3.1.0
+			 */
+			static inline Wait done() { return Wait{Type::DONE, 0}; }
+			/**
+			 * Resume the task again on the next loop without
+			 * waiting for anything.
+			 *
+			 * @return Condition to resume the task immediately.
+			 * @since 3.1.0
+			 */
+			static inline Wait yield() { return Wait{Type::YIELD, 0}; }
+			/**
+			 * Wait for input to be available.
+			 *
+			 * @return Condition to wait for input.
+			 * @since 3.1.0
+			 */
+			static inline Wait input() { return Wait{Type::INPUT, 0}; }
+			/**
+			 * Wait until a future time.
+			 *
+			 * The reference time is uuid::get_uptime_ms().
+			 *
+			 * @param[in] ms Uptime (in milliseconds) when the task
+			 *               should be resumed.
+			 * @return Condition to wait until a future time.
+			 * @since 3.1.0
+			 */
+			static inline Wait delay_until(uint64_t ms) { return Wait{Type::TIME, ms}; }
+			/**
+			 * Wait for a number of milliseconds.
+			 *
+			 * @param[in] ms Time (in milliseconds) to wait before the
+			 *               task should be resumed.
+			 * @return Condition to wait for a number of milliseconds.
+			 * @since 3.1.0
+			 */
+			static inline Wait delay_for(unsigned long ms) { return delay_until(uuid::get_uptime_ms() + ms); }
+			/**
+			 * Wait for space to be available to write to the stream
+			 * without waiting (availableForWrite()).
+			 *
+			 * The number of bytes must not be more than the stream
+			 * is able to buffer.
+			 *
+			 * @param[in] bytes Number of bytes that need to be
+			 *                  available.
+			 * @return Condition to wait for space to be available to
+			 *         output more data.
+			 * @since 3.1.0
+			 */
+			static inline Wait output(size_t bytes) { return Wait{Type::OUTPUT, bytes}; }
+
+		private:
+			friend Shell;
+
+			/**
+			 * Type of condition.
+			 *
+			 * @since 3.1.0
+			 */
+			enum class Type : uint8_t {
+				DONE, /*!< The task has finished. @since 3.1.0 */
+				YIELD, /*!< Resume on the next loop. @since 3.1.0 */
+				INPUT, /*!< Resume when input is available. @since 3.1.0 */
+				TIME, /*!< Resume at a future time. @since 3.1.0 */
+				OUTPUT, /*!< Resume when space is available on the stream. @since 3.1.0 */
+			};
+
+			/**
+			 * Create a condition to wait for.
+			 *
+			 * @param[in] type Type of condition.
+			 * @param[in] value Uptime or number of bytes for the
+			 *                  condition.
+			 * @since 3.1.0
+			 */
+			constexpr Wait(Type type, uint64_t value) : type_(type), value_(value) {}
+
+			Type type_; /*!< Type of condition. @since 3.1.0 */
+			uint64_t value_; /*!< Uptime (in milliseconds) or number of bytes for the condition. @since 3.1.0 */
+		};
+
+		virtual ~Task() = default;
+
+		/**
+		 * Resume execution of the task.
+		 *
+		 * The task can use the shell's input and output functions, but
+		 * it must not change the mode of the shell (e.g. by starting
+		 * another blocking function).
+		 *
+		 * @param[in] shell Shell instance where the task is executing.
+		 * @param[in] stop Request to finish so that the shell can stop
+		 *                 (true) or continue (false). The task is
+		 *                 resumed immediately when a stop is requested.
+		 * @return The condition to wait for before the task is resumed
+		 *         again, or Wait::done() if the task has finished.
+		 * @since 3.1.0
+		 */
+		virtual Wait resume(Shell &shell, bool stop) = 0;
+
+	protected:
+		Task() = default;
+	};
+
+#if UUID_CONSOLE_STATISTICS
+	/**
+	 * Statistics for a shell.
+	 *
+	 * Only available if UUID_CONSOLE_STATISTICS is enabled.
+	 *
+	 * @since 3.1.0
+	 */
+	struct Statistics {
+		uint64_t find_command_time = 0; /*!< Total time spent finding commands to execute, in microseconds. @since 3.1.0 */
+		uint64_t complete_command_time = 0; /*!< Total time spent completing commands, in microseconds. @since 3.1.0 */
+		uint64_t bytes_written = 0; /*!< Number of bytes written to the shell. @since 3.1.0 */
+		unsigned long log_messages_queued = 0; /*!< Number of log messages that have been queued. @since 3.1.0 */
+		unsigned long log_messages_dropped = 0; /*!< Number of log messages that were discarded because the queue was full. @since 3.1.0 */
+		unsigned long log_messages_output = 0; /*!< Number of log messages that have been output. @since 3.1.0 */
+		size_t log_messages_maximum = 0; /*!< Maximum number of log messages that have been queued at the same time. @since 3.1.0 */
+	};
+#endif
 
 	/**
 	 * Create a new Shell operating on a Stream with the given commands,
@@ -823,17 +1990,53 @@ public:
 	 */
 	Shell(Stream &stream, std::shared_ptr<Commands> commands, unsigned int context = 0, unsigned int flags = 0);
 
-	~Shell() = default;
+	~Shell() override;
 
+	/**
+	 * Get the default group of shells, used by start(), loop_all()
+	 * and loop_all_ready().
+	 *
+	 * @return The default group of shells.
+	 * @since 3.1.0
+	 */
+	static Group& default_group();
 	/**
 	 * Loop through all registered shell objects.
 	 *
 	 * Call loop_one() on every Shell (if it has not been stopped).
 	 * Any Shell that is stopped is then unregistered.
 	 *
+	 * Equivalent to calling Group::loop_all() on the default_group().
+	 *
 	 * @since 0.1.0
 	 */
 	static void loop_all();
+	/**
+	 * Loop through all registered shell objects that are ready to be
+	 * executed.
+	 *
+	 * Call loop_one() on every Shell (if it has not been stopped) that
+	 * has input available, queued log messages, an expired delay or
+	 * idle timeout, or is executing a blocking function. Any Shell that
+	 * is stopped is then unregistered.
+	 *
+	 * Delays and idle timeouts are kept in a min-heap of timers for
+	 * all shells, so only the shells with expired timers check their
+	 * deadline.
+	 *
+	 * Input that arrives on a stream after this returns is not
+	 * included in the time until the next deadline, so the caller must
+	 * also wait for input on the streams (if it waits at all).
+	 *
+	 * Equivalent to calling Group::loop_all_ready() on the
+	 * default_group().
+	 *
+	 * @return The time in milliseconds until a shell will next be
+	 *         ready without any more input or log messages (0 if a
+	 *         shell was executed, ULONG_MAX if there is no deadline).
+	 * @since 3.1.0
+	 */
+	static unsigned long loop_all_ready();
 
 	/**
 	 * Perform startup process for this shell.
@@ -849,6 +2052,25 @@ public:
 	 * @since 0.1.0
 	 */
 	void start();
+	/**
+	 * Perform startup process for this shell and register it with a
+	 * group of shells instead of the default group.
+	 *
+	 * The shell will be executed by the next call to
+	 * Group::loop_all() or Group::loop_all_ready() on the group. If
+	 * thread-safe operation is enabled then this can be called from a
+	 * different task to the one that loops through the group, but
+	 * the shell must not be used from that task after it has been
+	 * started.
+	 *
+	 * Do not call this function more than once.
+	 *
+	 * @param[in] group Group of shells to register with. Must remain
+	 *                  valid until the Shell has been stopped and
+	 *                  unregistered, or the group has been destroyed.
+	 * @since 3.1.0
+	 */
+	void start(Group &group);
 	/**
 	 * Perform one execution step of this shell.
 	 *
@@ -911,13 +2133,40 @@ public:
 	 * Set the current log level.
 	 *
 	 * This only affects newly received log messages, not messages that
-	 * have already been queued.
+	 * have already been queued. It has no effect if the shell outputs
+	 * log messages from a shared queue (shared_log_queue()).
 	 *
 	 * @param[in] level Minimum log level that the shell will receive
 	 *                  messages for.
 	 * @since 0.6.0
 	 */
 	void log_level(uuid::log::Level level);
+	/**
+	 * Get the shared queue of log messages that this shell outputs.
+	 *
+	 * @return The shared queue of log messages, or nullptr if the
+	 *         shell has its own queue.
+	 * @since 3.1.0
+	 */
+	inline const std::shared_ptr<SharedLogQueue>& shared_log_queue() const { return shared_log_queue_; }
+	/**
+	 * Set a shared queue of log messages to output, instead of
+	 * receiving log messages into a queue for this shell.
+	 *
+	 * Many shells can output the same log messages with only one copy
+	 * of each message, formatted once. Each shell only needs to keep
+	 * its position in the shared queue. The queue for this shell is
+	 * reduced to one message and log_level() is not used.
+	 *
+	 * Must be set before the shell is started, it has no effect
+	 * afterwards. Only messages added to the shared queue after it is
+	 * set will be output.
+	 *
+	 * @param[in] queue Shared queue of log messages (or nullptr to use
+	 *                  a queue for this shell).
+	 * @since 3.1.0
+	 */
+	void shared_log_queue(std::shared_ptr<SharedLogQueue> queue);
 
 	/**
 	 * Get the maximum length of a command line.
@@ -931,7 +2180,9 @@ public:
 	 *
 	 * Defaults to Shell::MAX_COMMAND_LINE_LENGTH.
 	 *
-	 * @param[in] length The maximum length of a command line in bytes.
+	 * @param[in] length The maximum length of a command line in bytes
+	 *                   (limited to UUID_CONSOLE_LINE_BUFFER_SIZE if it
+	 *                   is defined).
 	 * @since 0.6.0
 	 */
 	void maximum_command_line_length(size_t length);
@@ -947,10 +2198,282 @@ public:
 	 *
 	 * Defaults to Shell::MAX_LOG_MESSAGES.
 	 *
+	 * If UUID_CONSOLE_LOCK_FREE_LOG_QUEUE is enabled then the maximum
+	 * is rounded up to a power of 2 and it can't be changed after the
+	 * shell has been started or the log level has been set.
+	 *
 	 * @param[in] count The maximum number of queued log messages.
 	 * @since 0.6.0
 	 */
 	void maximum_log_messages(size_t count);
+	/**
+	 * Get the maximum number of queued log messages to output in one
+	 * execution step.
+	 *
+	 * @return The maximum number of log messages output by each call
+	 *         to loop_one().
+	 * @since 3.1.0
+	 */
+	size_t maximum_log_output_messages() const;
+	/**
+	 * Set the maximum number of queued log messages to output in one
+	 * execution step.
+	 *
+	 * Defaults to Shell::MAX_LOG_MESSAGES.
+	 *
+	 * @param[in] count The maximum number of log messages output by
+	 *                  each call to loop_one() (minimum 1).
+	 * @since 3.1.0
+	 */
+	void maximum_log_output_messages(size_t count);
+	/**
+	 * Get the maximum number of bytes of queued log messages to output
+	 * in one execution step.
+	 *
+	 * @return The maximum number of bytes of log messages output by
+	 *         each call to loop_one() (0 for no limit).
+	 * @since 3.1.0
+	 */
+	size_t maximum_log_output_bytes() const;
+	/**
+	 * Set the maximum number of bytes of queued log messages to output
+	 * in one execution step.
+	 *
+	 * No more log messages are output once the limit has been reached.
+	 * At least one message is always output, even if that message is
+	 * longer than the limit.
+	 *
+	 * Defaults to 0 (no limit).
+	 *
+	 * @param[in] bytes The maximum number of bytes of log messages
+	 *                  output by each call to loop_one() (0 for no
+	 *                  limit).
+	 * @since 3.1.0
+	 */
+	void maximum_log_output_bytes(size_t bytes);
+	/**
+	 * Get the maximum time to spend outputting queued log messages in
+	 * one execution step.
+	 *
+	 * @return The maximum time (in microseconds) spent on log messages
+	 *         by each call to loop_one() (0 for no limit).
+	 * @since 3.1.0
+	 */
+	unsigned long maximum_log_output_time() const;
+	/**
+	 * Set the maximum time to spend outputting queued log messages in
+	 * one execution step.
+	 *
+	 * No more log messages are output once the time limit has been
+	 * reached. At least one message is always output.
+	 *
+	 * Defaults to 0 (no limit).
+	 *
+	 * @param[in] time_us The maximum time (in microseconds) spent on
+	 *                    log messages by each call to loop_one() (0 for
+	 *                    no limit).
+	 * @since 3.1.0
+	 */
+	void maximum_log_output_time(unsigned long time_us);
+	/**
+	 * Determine if log messages wait for space to be available on the
+	 * stream.
+	 *
+	 * @return True if log messages are only output when there is space
+	 *         available on the stream, otherwise false.
+	 * @since 3.1.0
+	 */
+	bool log_output_backpressure() const;
+	/**
+	 * Set whether log messages wait for space to be available on the
+	 * stream.
+	 *
+	 * When enabled, a log message (and the command line that is output
+	 * again after it) is only output if there is enough space on the
+	 * stream for it to be written without waiting
+	 * (availableForWrite()). Otherwise it is deferred until a later
+	 * call to loop_one(), so that a slow client doesn't prevent other
+	 * shells from being executed. A log message that is larger than
+	 * the most space that has ever been available on the stream is
+	 * output when that much space is available. Log messages that are
+	 * discarded because the queue is full while they are deferred are
+	 * reported with a message indicating how many were dropped.
+	 *
+	 * The underlying stream must implement availableForWrite().
+	 *
+	 * Defaults to false (log messages are always output).
+	 *
+	 * @param[in] enabled Wait for space to be available on the stream
+	 *                    before outputting log messages.
+	 * @since 3.1.0
+	 */
+	void log_output_backpressure(bool enabled);
+	/**
+	 * Get the width of the terminal.
+	 *
+	 * @return The width of the terminal in columns (0 if unknown).
+	 * @since 3.1.0
+	 */
+	size_t terminal_width() const;
+	/**
+	 * Set the width of the terminal.
+	 *
+	 * If the width is known, log messages are inserted above the
+	 * command line using VT100 escape sequences (index, insert line,
+	 * save cursor and restore cursor) so that the command prompt and
+	 * the current command line don't need to be output again. The
+	 * command line is erased and output again after the log messages
+	 * (as it is when the width is unknown) if the command prompt and
+	 * command line don't fit on one line.
+	 *
+	 * Each byte of the command prompt, command line and log messages
+	 * is assumed to be one column wide. Escape sequences and multibyte
+	 * characters in log messages may result in blank lines.
+	 *
+	 * Defaults to 0 (unknown).
+	 *
+	 * @param[in] columns The width of the terminal in columns (0 if
+	 *                    unknown).
+	 * @since 3.1.0
+	 */
+	void terminal_width(size_t columns);
+	/**
+	 * Get the maximum number of input characters to process in one
+	 * execution step.
+	 *
+	 * @return The maximum number of input characters processed by
+	 *         each call to loop_one().
+	 * @since 3.1.0
+	 */
+	size_t maximum_input_batch() const;
+	/**
+	 * Set the maximum number of input characters to process in one
+	 * execution step.
+	 *
+	 * Input will be read until there is no more available, this limit
+	 * is reached or a line has been completed. The idle time is only
+	 * updated once for each batch of input.
+	 *
+	 * Defaults to Shell::MAX_INPUT_BATCH.
+	 *
+	 * @param[in] count The maximum number of input characters processed
+	 *                  by each call to loop_one().
+	 * @since 3.1.0
+	 */
+	void maximum_input_batch(size_t count);
+	/**
+	 * Get the maximum number of potential argument values to show when
+	 * completing a command.
+	 *
+	 * @return The maximum number of potential argument values to show
+	 *         (0 for no limit).
+	 * @since 3.1.0
+	 */
+	size_t maximum_argument_completions() const;
+	/**
+	 * Set the maximum number of potential argument values to show when
+	 * completing a command.
+	 *
+	 * Only the first values are kept and shown, but the argument is
+	 * still completed using all of the values. Argument completion
+	 * stream functions can stop providing values once no more are
+	 * needed.
+	 *
+	 * Defaults to 0 (no limit).
+	 *
+	 * @param[in] count The maximum number of potential argument values
+	 *                  to show (0 for no limit).
+	 * @since 3.1.0
+	 */
+	void maximum_argument_completions(size_t count);
+	/**
+	 * Get the size of the output buffer.
+	 *
+	 * @return The size of the output buffer in bytes, 0 if output is
+	 *         not buffered.
+	 * @since 3.1.0
+	 */
+	size_t output_buffer_size() const;
+	/**
+	 * Set the size of the output buffer.
+	 *
+	 * Output is collected in the buffer and written to the stream at
+	 * the end of each loop_one() call, when the buffer is full or when
+	 * flush() is called. This can be used to reduce the number of
+	 * separate writes (e.g. network packets) to the stream.
+	 *
+	 * Any existing buffered output will be written to the stream
+	 * first. Output that the stream doesn't accept is kept if there is
+	 * space for it in the new buffer.
+	 *
+	 * Defaults to 0 (no buffer).
+	 *
+	 * @param[in] size The size of the output buffer in bytes, 0 to
+	 *                 disable buffering.
+	 * @since 3.1.0
+	 */
+	void output_buffer_size(size_t size);
+	/**
+	 * Determine if the previous command completion is cached.
+	 *
+	 * @return True if the previous command completion is cached,
+	 *         otherwise false.
+	 * @since 3.1.0
+	 */
+	bool completion_cache() const;
+	/**
+	 * Set whether the previous command completion is cached.
+	 *
+	 * When the command line is extended (e.g. by typing more
+	 * characters) and completed again, only the commands that matched
+	 * previously are checked. When the argument being completed is
+	 * extended, the previous values returned by the argument
+	 * completion function are filtered again instead of calling it.
+	 * This must only be enabled if argument completion functions
+	 * return all of the values that start with the argument being
+	 * completed, regardless of how much of it has been entered.
+	 *
+	 * The cache is cleared when the context or flags change and when
+	 * a command is executed.
+	 *
+	 * Defaults to false (no cache).
+	 *
+	 * @param[in] enabled Cache the previous command completion.
+	 * @since 3.1.0
+	 */
+	void completion_cache(bool enabled);
+	/**
+	 * Determine if the text of the command prompt is cached.
+	 *
+	 * @return True if the text of the command prompt is cached,
+	 *         otherwise false.
+	 * @since 3.1.0
+	 */
+	bool prompt_cache() const;
+	/**
+	 * Set whether the text of the command prompt is cached.
+	 *
+	 * When enabled, prompt_prefix(), hostname_text(), context_text()
+	 * and prompt_suffix() are only called when the prompt is displayed
+	 * for the first time after the cache has been invalidated.
+	 *
+	 * The cache is invalidated when the context or flags change. Call
+	 * invalidate_prompt() if the text of the prompt changes for any
+	 * other reason.
+	 *
+	 * Defaults to false (no cache).
+	 *
+	 * @param[in] enabled Cache the text of the command prompt.
+	 * @since 3.1.0
+	 */
+	void prompt_cache(bool enabled);
+	/**
+	 * Invalidate the cached text of the command prompt, so that it is
+	 * created again the next time the prompt is displayed.
+	 *
+	 * @since 3.1.0
+	 */
+	inline void invalidate_prompt() { prompt_cached_ = false; }
 	/**
 	 * Get the idle timeout.
 	 *
@@ -993,6 +2516,8 @@ public:
 	 */
 	inline void enter_context(unsigned int context) {
 		context_.emplace_back(context);
+		clear_completion_cache();
+		invalidate_prompt();
 	}
 	/**
 	 * Pop a context off the stack.
@@ -1014,7 +2539,11 @@ public:
 	 * @param[in] flags Flag bits to add.
 	 * @since 0.1.0
 	 */
-	inline void add_flags(unsigned int flags) { flags_ |= flags; }
+	inline void add_flags(unsigned int flags) {
+		flags_ |= flags;
+		clear_completion_cache();
+		invalidate_prompt();
+	}
 	/**
 	 * Check if the current flags include all of the specified flags
 	 * and none of the specified not_flags.
@@ -1064,7 +2593,11 @@ public:
 	 * @param[in] flags Flag bits to remove.
 	 * @since 0.1.0
 	 */
-	inline void remove_flags(unsigned int flags) { flags_ &= ~flags; }
+	inline void remove_flags(unsigned int flags) {
+		flags_ &= ~flags;
+		clear_completion_cache();
+		invalidate_prompt();
+	}
 
 	/**
 	 * Prompt for a password to be entered on this shell.
@@ -1130,6 +2663,43 @@ public:
 	 *                     until normal execution resumes.
 	 */
 	void block_with(blocking_function function);
+	/**
+	 * Produce output on this shell in chunks until the function
+	 * returns true.
+	 *
+	 * This is executed as a blocking function. Every time loop_one()
+	 * is called, the function is called with the number of bytes that
+	 * can be written without waiting (availableForWrite()) so that it
+	 * can write the next chunk of output directly, instead of writing
+	 * all of the output at once. The function is not called if no
+	 * bytes can be written. The output is stopped without calling the
+	 * function if the shell is stopped.
+	 *
+	 * The underlying stream must implement availableForWrite().
+	 *
+	 * The shell must not be currently executing a blocking function.
+	 *
+	 * @param[in] function Function to be executed on every loop_one()
+	 *                     to produce the next chunk of output until
+	 *                     normal execution resumes.
+	 * @since 3.1.0
+	 */
+	void output_with(output_function function);
+	/**
+	 * Execute a resumable task on this shell until it has finished.
+	 *
+	 * This is executed as a blocking function, but the task is only
+	 * resumed when the condition that it is waiting for has been
+	 * met. The task is resumed for the first time on the next
+	 * loop_one().
+	 *
+	 * The shell must not be currently executing a blocking function.
+	 *
+	 * @param[in] task Task to be executed until normal execution
+	 *                 resumes.
+	 * @since 3.1.0
+	 */
+	void run_task(std::unique_ptr<Task> task);
 
 	/**
 	 * Check for available input.
@@ -1156,13 +2726,41 @@ public:
 	 * next one.
 	 *
 	 * The shell must be currently executing a blocking function
-	 * otherwise it will always return -1.
+	 * otherwise it will always return -1.
+	 *
+	 * @return An unsigned char if input is available, otherwise -1.
+	 * @since 0.2.0
+	 */
+	int peek() final override;
+	/**
+	 * Read multiple bytes from the available input.
+	 *
+	 * The first LF following a CR is consumed once at the start and
+	 * then the bytes that are available are read from the underlying
+	 * stream using Stream::readBytes() directly into the buffer. This
+	 * does not wait for more input to become available.
+	 *
+	 * The shell must be currently executing a blocking function
+	 * otherwise it will always return 0.
 	 *
-	 * @return An unsigned char if input is available, otherwise -1.
-	 * @since 0.2.0
+	 * @param[out] buffer Buffer to store the input.
+	 * @param[in] length Maximum number of bytes to read.
+	 * @return The number of bytes that were read.
+	 * @since 3.1.0
 	 */
-	int peek() final override;
+	size_t read_bytes(uint8_t *buffer, size_t length);
 
+	/**
+	 * Get the number of bytes that can be written to the output
+	 * stream without waiting.
+	 *
+	 * This excludes output that has been buffered by the shell but
+	 * not yet written to the stream.
+	 *
+	 * @return The number of bytes that can be written.
+	 * @since 3.1.0
+	 */
+	int availableForWrite() final override;
 	/**
 	 * Write one byte to the output stream.
 	 *
@@ -1181,12 +2779,16 @@ public:
 	 */
 	size_t write(const uint8_t *buffer, size_t size) final override;
 	/**
-	 * Does nothing.
+	 * Write any buffered output to the stream.
+	 *
+	 * This does not wait for the stream to finish transmitting its own
+	 * buffered data. Output that the stream doesn't accept remains
+	 * buffered until the next flush.
 	 *
 	 * This is a pure virtual function in Arduino's Stream class, which
 	 * makes no sense because that class is for input and this is an
 	 * output function. Later versions move it to Print as an empty
-	 * virtual function so this is here for backward compatibility.
+	 * virtual function.
 	 *
 	 * @since 3.0.0
 	 */
@@ -1258,12 +2860,58 @@ public:
 	 * @since 0.9.0
 	 */
 	Commands::AvailableCommands available_commands() const;
+	/**
+	 * Get the memory arena used for temporary allocations when finding
+	 * and completing commands.
+	 *
+	 * Set the size of the arena to reuse the same memory for every
+	 * command line instead of allocating it from the heap (the arena
+	 * is not used by default).
+	 *
+	 * @return The memory arena for this shell.
+	 * @since 3.1.0
+	 */
+	inline ScratchArena &scratch_arena() { return scratch_arena_; }
 	/**
 	 * Output a list of all available commands with their arguments.
 	 *
 	 * @since 0.4.0
 	 */
 	void print_all_available_commands();
+#if UUID_CONSOLE_STATISTICS
+	/**
+	 * Get the statistics for this shell.
+	 *
+	 * Log messages are counted as they are output, so the messages
+	 * that are still queued are included in the number queued but
+	 * messages that have been discarded are only counted as dropped
+	 * when the next message is output.
+	 *
+	 * Only available if UUID_CONSOLE_STATISTICS is enabled.
+	 *
+	 * @return Statistics for this shell.
+	 * @since 3.1.0
+	 */
+	Statistics statistics() const;
+	/**
+	 * Reset the statistics for this shell.
+	 *
+	 * Only available if UUID_CONSOLE_STATISTICS is enabled.
+	 *
+	 * @since 3.1.0
+	 */
+	void reset_statistics();
+	/**
+	 * Output the statistics for this shell and the number of times each
+	 * available command has been executed, with the total time spent
+	 * executing it.
+	 *
+	 * Only available if UUID_CONSOLE_STATISTICS is enabled.
+	 *
+	 * @since 3.1.0
+	 */
+	void print_statistics();
+#endif
 
 protected:
 	/**
@@ -1467,6 +3115,27 @@ private:
 		blocking_function blocking_function_; /*!< Function executed on every loop_one(). @since 0.2.0 */
 		bool consume_line_feed_ = true; /*!< Stream input should try to consume the first line feed following a carriage return. @since 0.2.0 */
 		bool stop_ = false; /*!< There is a stop pending for the shell. @since 0.2.0 */
+		std::unique_ptr<Task> task_; /*!< Task executed instead of the blocking function (if set). @since 3.1.0 */
+		Task::Wait wait_ = Task::Wait::yield(); /*!< Condition that the task is waiting for. @since 3.1.0 */
+	};
+
+	/**
+	 * Timer for a shell's next deadline.
+	 *
+	 * @since 3.1.0
+	 */
+	struct Timer {
+		uint64_t time; /*!< Uptime in milliseconds when the timer expires. @since 3.1.0 */
+		Shell *shell; /*!< Shell that the timer is for. @since 3.1.0 */
+
+		/**
+		 * Compare the expiry time of two timers.
+		 *
+		 * @param[in] other Timer to compare with.
+		 * @return True if this timer expires after the other timer.
+		 * @since 3.1.0
+		 */
+		inline bool operator>(const Timer &other) const { return time > other.time; }
 	};
 
 	/**
@@ -1488,27 +3157,173 @@ private:
 		 * @since 0.1.0
 		 */
 		QueuedLogMessage(unsigned long id, std::shared_ptr<uuid::log::Message> &&content);
+		/**
+		 * Create an empty queued log message.
+		 *
+		 * @since 3.1.0
+		 */
+		QueuedLogMessage() = default;
 		~QueuedLogMessage() = default;
 
-		unsigned long id_; /*!< Sequential identifier for this log message. @since 0.1.0 */
+		unsigned long id_ = 0; /*!< Sequential identifier for this log message. @since 0.1.0 */
 		std::shared_ptr<const uuid::log::Message> content_; /*!< Log message content. @since 0.1.0 */
+		std::shared_ptr<const FormattedLogMessage> formatted_; /*!< Log message formatted for output (or nullptr if it has not been formatted yet). @since 3.1.0 */
 	};
 
-	Shell(const Shell&) = delete;
-	Shell& operator=(const Shell&) = delete;
-
 	/**
-	 * Get registered running shells to be executed.
+	 * Fixed capacity queue of log messages.
 	 *
-	 * @return Registered running shells to be executed.
-	 * @since 0.7.4
+	 * Storage for the messages is allocated when the capacity is set,
+	 * so adding and removing messages does not use the heap. The
+	 * oldest message is discarded when a message is added to a full
+	 * queue.
+	 *
+	 * If UUID_CONSOLE_LOCK_FREE_LOG_QUEUE is 1 (one producer) or 2
+	 * (multiple producers) then messages can be added and removed
+	 * concurrently without a mutex. There must only be one consumer.
+	 * The capacity is rounded up to a power of 2 and the newest
+	 * message is discarded when a message is added to a full queue.
+	 *
+	 * @since 3.1.0
 	 */
-	static std::set<std::shared_ptr<Shell>>& registered_shells();
+	class LogMessageQueue {
+	public:
+		/**
+		 * Create a queue of log messages.
+		 *
+		 * @param[in] capacity Maximum number of log messages (minimum 1).
+		 * @since 3.1.0
+		 */
+		explicit LogMessageQueue(size_t capacity);
+		~LogMessageQueue() = default;
+
+		/**
+		 * Get the maximum number of log messages.
+		 *
+		 * @return The maximum number of log messages.
+		 * @since 3.1.0
+		 */
+		inline size_t capacity() const { return capacity_; }
+		/**
+		 * Set the maximum number of log messages.
+		 *
+		 * Reallocates the storage for messages. The oldest messages
+		 * are discarded if there are more than the new capacity.
+		 *
+		 * Must not be called concurrently with any other function.
+		 *
+		 * @param[in] capacity Maximum number of log messages (minimum 1).
+		 * @since 3.1.0
+		 */
+		void capacity(size_t capacity);
+
+		/**
+		 * Get the number of log messages in the queue.
+		 *
+		 * @return The number of log messages in the queue.
+		 * @since 3.1.0
+		 */
+		size_t size() const;
+		/**
+		 * Check if the queue is empty.
+		 *
+		 * @return True if there are no log messages in the queue,
+		 *         otherwise false.
+		 * @since 3.1.0
+		 */
+		inline bool empty() const { return size() == 0; }
+
+		/**
+		 * Add a log message to the end of the queue, discarding the
+		 * oldest (or newest, if lock-free) message if the queue is
+		 * full.
+		 *
+		 * @param[in] content Log message content.
+		 * @since 3.1.0
+		 */
+		void push(std::shared_ptr<uuid::log::Message> &&content);
+		/**
+		 * Remove the log message at the front of the queue.
+		 *
+		 * Identifiers are assigned in the order that messages are
+		 * removed from the queue, skipping one identifier for every
+		 * message that was discarded.
+		 *
+		 * @param[out] message Log message that was removed from the
+		 *                     queue.
+		 * @return True if a message was removed, false if the queue is
+		 *         empty.
+		 * @since 3.1.0
+		 */
+		bool pop(QueuedLogMessage &message);
+
+	private:
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+		/**
+		 * Remove the log message at the front of the queue without
+		 * assigning an identifier.
+		 *
+		 * @param[out] content Log message content that was removed
+		 *                     from the queue.
+		 * @return True if a message was removed, false if the queue is
+		 *         empty.
+		 * @since 3.1.0
+		 */
+		bool pop(std::shared_ptr<uuid::log::Message> &content);
+		/**
+		 * Collect the number of log messages that producers have
+		 * discarded, so that their identifiers can be skipped when
+		 * the consumer reaches the end of the current queue.
+		 *
+		 * @since 3.1.0
+		 */
+		void update_discarded();
+
+		/**
+		 * Position in the queue for a log message.
+		 *
+		 * @since 3.1.0
+		 */
+		struct Slot {
+# if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE > 1
+			std::atomic<size_t> sequence{0}; /*!< Queue position when this slot can be written (sequence == position) or read (sequence == position + 1). @since 3.1.0 */
+# endif
+			std::shared_ptr<uuid::log::Message> content; /*!< Log message content. @since 3.1.0 */
+		};
+
+		std::unique_ptr<Slot[]> slots_; /*!< Storage for log messages. @since 3.1.0 */
+		size_t capacity_ = 0; /*!< Maximum number of log messages (a power of 2). @since 3.1.0 */
+		std::atomic<size_t> head_{0}; /*!< Queue position of the oldest log message, only written by the consumer. @since 3.1.0 */
+		std::atomic<size_t> tail_{0}; /*!< Queue position for the next log message, only written by producers. @since 3.1.0 */
+		std::atomic<unsigned long> discarded_{0}; /*!< Number of log messages discarded because the queue was full, reset by the consumer. @since 3.1.0 */
+		unsigned long next_id_ = 0; /*!< The next identifier to use for log messages removed from the queue, only used by the consumer. @since 3.1.0 */
+		unsigned long pending_discarded_ = 0; /*!< Number of discarded log messages that have not been skipped in the identifiers yet, only used by the consumer. @since 3.1.0 */
+		size_t pending_discarded_position_ = 0; /*!< Queue position of the first log message after the pending discarded log messages, only used by the consumer. @since 3.1.0 */
+#else
+		std::unique_ptr<QueuedLogMessage[]> messages_; /*!< Storage for log messages. @since 3.1.0 */
+		size_t capacity_ = 0; /*!< Maximum number of log messages. @since 3.1.0 */
+		size_t head_ = 0; /*!< Position of the oldest log message in storage. @since 3.1.0 */
+		size_t size_ = 0; /*!< Number of log messages in the queue. @since 3.1.0 */
+		unsigned long next_id_ = 0; /*!< The next identifier to use for log messages added to the queue. @since 3.1.0 */
+#endif
+	};
+
+	static constexpr size_t PRINTF_BUFFER_SIZE = 64; /*!< Size of the stack buffer used to format messages, larger messages will be allocated on the heap. @since 3.1.0 */
+	static constexpr uint64_t LOG_OUTPUT_RETRY_MS = 10; /*!< Time to wait before checking again if there is space for a deferred log message to be output. @since 3.1.0 */
+
+#if UUID_CONSOLE_STATISTICS
+	friend Commands;
+#endif
+
+	Shell(const Shell&) = delete;
+	Shell& operator=(const Shell&) = delete;
 
 	/**
 	 * Perform one execution step in Mode::NORMAL mode.
 	 *
 	 * Read characters and execute commands or invoke tab completion.
+	 * Stops reading after a line has been completed or when
+	 * maximum_input_batch() characters have been read.
 	 *
 	 * @since 0.1.0
 	 */
@@ -1517,6 +3332,8 @@ private:
 	 * Perform one execution step in Mode::PASSWORD mode.
 	 *
 	 * Read characters until interrupted or password entry is complete.
+	 * Stops reading after maximum_input_batch() characters have been
+	 * read.
 	 *
 	 * @since 0.1.0
 	 */
@@ -1538,6 +3355,23 @@ private:
 	 */
 	void loop_blocking();
 
+	/**
+	 * Create the text of the command prompt (without the current
+	 * command line).
+	 *
+	 * @return The text of the command prompt.
+	 * @since 3.1.0
+	 */
+	std::string prompt_text();
+	/**
+	 * Determine if the blocking function or task should be executed.
+	 *
+	 * @return True if there is no task, the shell is being stopped or
+	 *         the condition that the task is waiting for has been met,
+	 *         otherwise false.
+	 * @since 3.1.0
+	 */
+	bool blocking_ready();
 	/**
 	 * Output a prompt on the shell.
 	 *
@@ -1545,6 +3379,8 @@ private:
 	 * e.g. the command prompt with the current command line (for
 	 * Mode::NORMAL mode).
 	 *
+	 * The text of the command prompt is output in one write.
+	 *
 	 * @since 0.1.0
 	 */
 	void display_prompt();
@@ -1554,18 +3390,41 @@ private:
 	 * @since 0.1.0
 	 */
 	void output_logs();
+	/**
+	 * Get the next log message to output, which may have been deferred
+	 * by a previous call to output_logs().
+	 *
+	 * @param[out] message Log message to output.
+	 * @return True if there is a log message to output, otherwise
+	 *         false.
+	 * @since 3.1.0
+	 */
+	bool next_log_message(QueuedLogMessage &message);
 	/**
 	 * Try to execute a command with the current command line.
 	 *
 	 * @since 0.1.0
 	 */
 	void process_command();
+	/**
+	 * Try to execute a command.
+	 *
+	 * @param[in] command_line Command line parameters.
+	 * @since 3.1.0
+	 */
+	void process_command(CommandLine &&command_line);
 	/**
 	 * Try to complete a command from the current command line.
 	 *
 	 * @since 0.1.0
 	 */
 	void process_completion();
+	/**
+	 * Clear the cache of the previous command completion (if enabled).
+	 *
+	 * @since 3.1.0
+	 */
+	void clear_completion_cache();
 	/**
 	 * Finish password entry.
 	 *
@@ -1584,6 +3443,40 @@ private:
 	 */
 	void check_idle_timeout();
 
+	/**
+	 * Determine if this shell is ready to be executed.
+	 *
+	 * @return True if this shell has input available, queued log
+	 *         messages, an expired timer or is executing a blocking
+	 *         function, otherwise false.
+	 * @since 3.1.0
+	 */
+	bool ready();
+	/**
+	 * Get the next time that this shell will need to be executed
+	 * without any more input or log messages.
+	 *
+	 * @return The uptime in milliseconds of the delay expiry, idle
+	 *         timeout or next check for space to output a deferred log
+	 *         message, or UINT64_MAX if there is no deadline.
+	 * @since 3.1.0
+	 */
+	uint64_t deadline() const;
+	/**
+	 * Schedule a timer for this shell in its group, if there isn't
+	 * already an earlier one.
+	 *
+	 * @param[in] time Uptime in milliseconds for the timer to expire.
+	 * @since 3.1.0
+	 */
+	void schedule_timer(uint64_t time);
+	/**
+	 * Remove all timers for this shell.
+	 *
+	 * @since 3.1.0
+	 */
+	void unschedule_timer();
+
 	/**
 	 * Delete a word from the command line buffer.
 	 *
@@ -1596,6 +3489,9 @@ private:
 	/**
 	 * Output a message.
 	 *
+	 * Messages that fit in Shell::PRINTF_BUFFER_SIZE bytes are
+	 * formatted on the stack without any heap allocation.
+	 *
 	 * @param[in] format Format string.
 	 * @param[in] ap Variable arguments pointer for format string.
 	 * @return The number of bytes that were output.
@@ -1605,6 +3501,9 @@ private:
 	/**
 	 * Output a message.
 	 *
+	 * Messages that fit in Shell::PRINTF_BUFFER_SIZE bytes are
+	 * formatted on the stack without any heap allocation.
+	 *
 	 * @param[in] format Format string (flash string).
 	 * @param[in] ap Variable arguments pointer for format string.
 	 * @return The number of bytes that were output.
@@ -1616,23 +3515,259 @@ private:
 	std::shared_ptr<Commands> commands_; /*!< Commands available for execution in this shell. @since 0.1.0 */
 	std::deque<unsigned int> context_; /*!< Context stack for this shell. Affects which commands are available. Should never be empty. @since 0.1.0 */
 	unsigned int flags_ = 0; /*!< Current flags for this shell. Affects which commands are available. @since 0.1.0 */
-#if UUID_CONSOLE_THREAD_SAFE
+#if UUID_CONSOLE_THREAD_SAFE && !UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
 	mutable std::mutex mutex_; /*!< Mutex for queued log messages. @since 1.0.0 */
 #endif
-	unsigned long log_message_id_ = 0; /*!< The next identifier to use for queued log messages. @since 0.1.0 */
-	std::list<QueuedLogMessage> log_messages_; /*!< Queued log messages, in the order they were received. @since 0.1.0 */
-	size_t maximum_log_messages_ = MAX_LOG_MESSAGES; /*!< Maximum command line length in bytes. @since 0.6.0 */
-	std::string line_buffer_; /*!< Command line buffer. Limited to maximum_command_line_length() bytes. @since 0.1.0 */
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+	bool log_handler_registered_ = false; /*!< The log handler has been registered, so log messages could be added to the queue at any time. @since 3.1.0 */
+#endif
+	LogMessageQueue log_messages_{MAX_LOG_MESSAGES}; /*!< Queued log messages, in the order they were received. @since 0.1.0 */
+	std::shared_ptr<SharedLogQueue> shared_log_queue_; /*!< Shared queue of log messages to output instead of log_messages_ (or nullptr). @since 3.1.0 */
+	QueuedLogMessage deferred_log_message_; /*!< Log message that was not output because there wasn't enough space available on the stream. @since 3.1.0 */
+	size_t deferred_log_space_ = 0; /*!< Space required on the stream to output the deferred log message. @since 3.1.0 */
+	uint64_t deferred_log_time_ = 0; /*!< Uptime in milliseconds when the log message was deferred. @since 3.1.0 */
+	size_t log_output_capacity_ = 0; /*!< Most space that has been available on the stream, used as its capacity if a log message is larger. @since 3.1.0 */
+	unsigned long log_message_output_id_ = 0; /*!< The identifier of the next log message expected to be output, to detect dropped messages. @since 3.1.0 */
+	bool log_output_backpressure_ = false; /*!< Only output log messages when there is enough space available on the stream. @since 3.1.0 */
+#if UUID_CONSOLE_STATISTICS
+	Statistics statistics_; /*!< Statistics for this shell, except for the number of log messages currently queued. @since 3.1.0 */
+#endif
+	ScratchArena scratch_arena_; /*!< Memory arena for temporary allocations when finding and completing commands. @since 3.1.0 */
+	std::unique_ptr<Commands::CompletionCache> completion_cache_; /*!< Cache of the previous command completion (if enabled). @since 3.1.0 */
+	std::string prompt_; /*!< Text of the command prompt, if it has been cached. @since 3.1.0 */
+	bool prompt_cache_ = false; /*!< Cache the text of the command prompt. @since 3.1.0 */
+	bool prompt_cached_ = false; /*!< The text of the command prompt has been cached and is still valid. @since 3.1.0 */
+	LineBuffer line_buffer_; /*!< Command line buffer. Limited to maximum_command_line_length() bytes. @since 0.1.0 */
 	size_t maximum_command_line_length_ = MAX_COMMAND_LINE_LENGTH; /*!< Maximum command line length in bytes. @since 0.6.0 */
+	size_t maximum_log_output_messages_ = MAX_LOG_MESSAGES; /*!< Maximum number of log messages to output in one loop. @since 3.1.0 */
+	size_t maximum_log_output_bytes_ = 0; /*!< Maximum number of bytes of log messages to output in one loop (0 for no limit). @since 3.1.0 */
+	unsigned long maximum_log_output_time_ = 0; /*!< Maximum time to spend outputting log messages in one loop, in microseconds (0 for no limit). @since 3.1.0 */
+	size_t terminal_width_ = 0; /*!< Width of the terminal in columns (0 if unknown). @since 3.1.0 */
+	size_t prompt_length_ = 0; /*!< Length of the text of the command prompt that is currently displayed. @since 3.1.0 */
+	size_t maximum_input_batch_ = MAX_INPUT_BATCH; /*!< Maximum number of input characters to process in one loop. @since 3.1.0 */
+	size_t maximum_argument_completions_ = 0; /*!< Maximum number of potential argument values to show when completing a command (0 for no limit). @since 3.1.0 */
 	unsigned char previous_ = 0; /*!< Previous character that was entered on the command line. Used to detect CRLF line endings. @since 0.1.0 */
 	Mode mode_ = Mode::NORMAL; /*!< Current execution mode. @since 0.1.0 */
 	std::unique_ptr<ModeData> mode_data_ = nullptr; /*!< Data associated with the current execution mode. @since 0.1.0 */
+	std::unique_ptr<uint8_t[]> output_buffer_; /*!< Buffered output that has not been written to the stream. @since 3.1.0 */
+	size_t output_buffer_size_ = 0; /*!< Size of the output buffer in bytes. @since 3.1.0 */
+	size_t output_buffer_length_ = 0; /*!< Length of buffered output in bytes. @since 3.1.0 */
+	bool started_ = false; /*!< Indicates that the shell has been started. @since 3.1.0 */
 	bool stopped_ = false; /*!< Indicates that the shell has been stopped. @since 0.1.0 */
 	bool prompt_displayed_ = false; /*!< Indicates that a command prompt has been displayed, so that the output of invoke_command() is correct. @since 0.1.0 */
 	uint64_t idle_time_ = 0; /*!< Time the shell became idle. @since 0.7.0 */
+	uint64_t timer_ = UINT64_MAX; /*!< Expiry time of this shell's current timer, UINT64_MAX if there isn't one. @since 3.1.0 */
+	bool timer_expired_ = false; /*!< The deadline for this shell has passed. @since 3.1.0 */
+	Group *group_ = nullptr; /*!< Group of shells that this shell is registered with (after it has been added by the group). @since 3.1.0 */
 	uint64_t idle_timeout_ = 0; /*!< Idle timeout (in milliseconds). @since 0.7.0 */
 };
 
+/**
+ * Group of shells that are executed together.
+ *
+ * Each group has its own set of registered shells and timers, so that
+ * shells can be executed by different tasks (e.g. one task for each
+ * CPU core) by starting them in different groups. Shells started with
+ * Shell::start() are registered with Shell::default_group().
+ *
+ * Shells can be registered with a group from any task if thread-safe
+ * operation is enabled. They are added to the group by the next loop
+ * through the group and removed by the loop when they have been
+ * stopped. All other functions of a group and its shells must only be
+ * called from the task that loops through the group.
+ *
+ * @since 3.1.0
+ */
+class Shell::Group {
+public:
+	/**
+	 * Create a new empty group of shells.
+	 *
+	 * @since 3.1.0
+	 */
+	Group() = default;
+	~Group();
+
+	/**
+	 * Loop through all shell objects registered with this group.
+	 *
+	 * Call loop_one() on every Shell (if it has not been stopped).
+	 * Any Shell that is stopped is then unregistered.
+	 *
+	 * @since 3.1.0
+	 */
+	void loop_all();
+	/**
+	 * Loop through all shell objects registered with this group that
+	 * are ready to be executed.
+	 *
+	 * Call loop_one() on every Shell (if it has not been stopped) that
+	 * has input available, queued log messages, an expired delay or
+	 * idle timeout, or is executing a blocking function. Any Shell that
+	 * is stopped is then unregistered.
+	 *
+	 * @return The time in milliseconds until a shell will next be
+	 *         ready without any more input or log messages (0 if a
+	 *         shell was executed, ULONG_MAX if there is no deadline).
+	 * @since 3.1.0
+	 */
+	unsigned long loop_all_ready();
+
+private:
+	friend Shell;
+
+	Group(const Group&) = delete;
+	Group& operator=(const Group&) = delete;
+
+	/**
+	 * Register a shell with this group, to be added by the next loop
+	 * through the group.
+	 *
+	 * @param[in] shell Shell to register.
+	 * @since 3.1.0
+	 */
+	void add(std::shared_ptr<Shell> shell);
+	/**
+	 * Add shells that have been registered since the last loop
+	 * through the group.
+	 *
+	 * @since 3.1.0
+	 */
+	void add_pending();
+	/**
+	 * Unregister a shell that has been stopped.
+	 *
+	 * @param[in] shell Position of the shell to unregister.
+	 * @return Position of the next shell.
+	 * @since 3.1.0
+	 */
+	std::set<std::shared_ptr<Shell>>::iterator remove(std::set<std::shared_ptr<Shell>>::iterator shell);
+
+#if UUID_CONSOLE_THREAD_SAFE
+	std::mutex mutex_; /*!< Mutex for shells that are waiting to be added. @since 3.1.0 */
+#endif
+	std::vector<std::shared_ptr<Shell>> pending_; /*!< Shells that are waiting to be added by the next loop. @since 3.1.0 */
+	/**
+	 * Timers for all shells in this group, as a min-heap ordered by
+	 * expiry time.
+	 *
+	 * Timers that don't match Shell::timer_ for their shell have been
+	 * replaced by an earlier timer and are discarded when they
+	 * expire.
+	 *
+	 * @since 3.1.0
+	 */
+	std::vector<Timer> timers_;
+	std::set<std::shared_ptr<Shell>> shells_; /*!< Registered running shells to be executed. @since 3.1.0 */
+};
+
+/**
+ * Queue of log messages shared by many shells.
+ *
+ * Each log message is added to the queue and formatted once, and each
+ * shell using the queue only keeps its own position in it. The memory
+ * and time needed to output log messages to many shells (e.g. network
+ * monitoring sessions) is then mostly independent of the number of
+ * shells.
+ *
+ * The oldest message is discarded when a message is added to a full
+ * queue. Shells that had not output that message yet will detect that
+ * it was dropped.
+ *
+ * Log messages can be added from any task if thread-safe operation is
+ * enabled.
+ *
+ * @since 3.1.0
+ */
+class Shell::SharedLogQueue: public uuid::log::Handler {
+public:
+	/**
+	 * Create a shared queue of log messages and register it to receive
+	 * log messages at uuid::log::Level::NOTICE.
+	 *
+	 * @param[in] capacity Maximum number of log messages (minimum 1).
+	 * @since 3.1.0
+	 */
+	explicit SharedLogQueue(size_t capacity = MAX_LOG_MESSAGES);
+	~SharedLogQueue() override = default;
+
+	/**
+	 * Get the maximum number of log messages.
+	 *
+	 * @return The maximum number of log messages.
+	 * @since 3.1.0
+	 */
+	inline size_t capacity() const { return capacity_; }
+
+	/**
+	 * Get the current log level.
+	 *
+	 * @return The current log level.
+	 * @since 3.1.0
+	 */
+	uuid::log::Level log_level() const;
+	/**
+	 * Set the current log level.
+	 *
+	 * @param[in] level Minimum log level that the queue will receive
+	 *                  messages for.
+	 * @since 3.1.0
+	 */
+	void log_level(uuid::log::Level level);
+
+	/**
+	 * Add a new log message to the queue and format it.
+	 *
+	 * @param[in] message New log message, shared by all handlers.
+	 * @since 3.1.0
+	 */
+	void operator<<(std::shared_ptr<uuid::log::Message> message) override;
+
+private:
+	friend Shell;
+
+	SharedLogQueue(const SharedLogQueue&) = delete;
+	SharedLogQueue& operator=(const SharedLogQueue&) = delete;
+
+	/**
+	 * Get the identifier of the next log message to be added.
+	 *
+	 * @return The identifier of the next log message.
+	 * @since 3.1.0
+	 */
+	unsigned long next_id() const;
+	/**
+	 * Get the number of log messages in the queue from a position.
+	 *
+	 * @param[in] id Identifier of the next log message to read.
+	 * @return The number of log messages available to read.
+	 * @since 3.1.0
+	 */
+	size_t available(unsigned long id) const;
+	/**
+	 * Read a log message from a position in the queue.
+	 *
+	 * If the log message has already been discarded then the oldest
+	 * message is read instead.
+	 *
+	 * @param[in] id Identifier of the next log message to read.
+	 * @param[out] message Log message that was read.
+	 * @return True if a message was read, false if there are no more
+	 *         messages.
+	 * @since 3.1.0
+	 */
+	bool read(unsigned long id, QueuedLogMessage &message) const;
+
+#if UUID_CONSOLE_THREAD_SAFE
+	mutable std::mutex mutex_; /*!< Mutex for the queue. @since 3.1.0 */
+#endif
+	std::unique_ptr<QueuedLogMessage[]> messages_; /*!< Storage for the messages. @since 3.1.0 */
+	size_t capacity_; /*!< Maximum number of messages. @since 3.1.0 */
+	size_t head_ = 0; /*!< Position of the oldest message. @since 3.1.0 */
+	size_t size_ = 0; /*!< Number of messages. @since 3.1.0 */
+	unsigned long next_id_ = 0; /*!< The identifier to use for the next log message. @since 3.1.0 */
+};
+
 /**
  * Representation of a command line, with parameters separated by
  * spaces and an optional trailing space.
@@ -1656,6 +3791,15 @@ public:
 	 * @since 0.4.0
 	 */
 	explicit CommandLine(const std::string &line);
+	/**
+	 * Parse a command line into separate parameters using built-in
+	 * escaping rules.
+	 *
+	 * @param[in] line Command line to parse.
+	 * @param[in] length Length of the command line in bytes.
+	 * @since 3.1.0
+	 */
+	CommandLine(const char *line, size_t length);
 
 	/**
 	 * Create a command line from one or more vectors of parameters.
@@ -1686,6 +3830,19 @@ public:
 	 * @since 0.4.0
 	 */
 	std::string to_string(size_t reserve = Shell::MAX_COMMAND_LINE_LENGTH) const;
+	/**
+	 * Format a command line from separate parameters using built-in
+	 * escaping rules, replacing the contents of a line buffer.
+	 *
+	 * The line buffer is not modified if the command line does not fit
+	 * in it.
+	 *
+	 * @param[in,out] buffer Line buffer to replace the contents of.
+	 * @return True if the command line was formatted in the buffer,
+	 *         false if it is too long.
+	 * @since 3.1.0
+	 */
+	bool to_string(LineBuffer &buffer) const;
 
 	/**
 	 * Get the total size of the command line parameters, taking into
@@ -1794,6 +3951,44 @@ public:
 	bool trailing_space = false; /*!< Command line has a trailing space. @since 0.4.0 */
 
 private:
+	friend Shell;
+
+	/**
+	 * Format a command line from separate parameters using built-in
+	 * escaping rules.
+	 *
+	 * @tparam T Type of output buffer.
+	 * @param[out] line Output buffer, which must be empty.
+	 * @since 3.1.0
+	 */
+	template <class T>
+	void format(T &line) const;
+	/**
+	 * Append one parameter to a command line using built-in escaping
+	 * rules.
+	 *
+	 * @tparam T Type of output buffer.
+	 * @tparam Chars Type of source of characters in the parameter,
+	 *               with a next(char&) function that returns false at
+	 *               the end of the parameter.
+	 * @param[in,out] line Output buffer.
+	 * @param[in] chars Characters in the parameter.
+	 * @param[in] escape Escape special characters in the parameter.
+	 * @since 3.1.0
+	 */
+	template <class T, class Chars>
+	static void format_parameter(T &line, Chars chars, bool escape);
+	/**
+	 * Append a flash string parameter to a command line using built-in
+	 * escaping rules, in the same format as to_string().
+	 *
+	 * @param[in,out] line Command line to append to.
+	 * @param[in] parameter Parameter to append.
+	 * @param[in] escape Escape special characters in the parameter.
+	 * @since 3.1.0
+	 */
+	static void format_flash_parameter(std::string &line, const __FlashStringHelper *parameter, bool escape);
+
 	std::vector<std::string> parameters_; /*!< Separate command line parameters. @since 0.4.0 */
 	size_t escape_parameters_ = std::numeric_limits<size_t>::max(); /*!< Number of initial arguments to escape in output. @since 0.5.0 */
 };
@@ -1810,6 +4005,22 @@ struct Commands::Completion {
 	CommandLine replacement; /*!< Replacement matching full or partial command line. @since 0.1.0 */
 };
 
+/**
+ * Cache of the previous command completion for a Shell.
+ *
+ * @since 3.1.0
+ */
+struct Commands::CompletionCache {
+	unsigned long revision = 0; /*!< Revision of the commands that the cache refers to. @since 3.1.0 */
+	std::vector<std::string> parameters; /*!< Parameters of the previous command line. @since 3.1.0 */
+	bool trailing_space = false; /*!< The previous command line had a trailing space. @since 3.1.0 */
+	std::vector<const Command*> commands; /*!< Commands that matched the previous command line, in the order that they were defined. @since 3.1.0 */
+	const Command *argument_command = nullptr; /*!< Command that arguments were previously completed for (or nullptr). @since 3.1.0 */
+	std::vector<std::string> arguments; /*!< Arguments prior to the argument that was previously completed. @since 3.1.0 */
+	std::string next_argument; /*!< Argument that was previously completed. @since 3.1.0 */
+	std::vector<std::string> potential_arguments; /*!< Potential values matching the argument that was previously completed. @since 3.1.0 */
+};
+
 } // namespace console
 
 } // namespace uuid
@@ -44,6 +44,10 @@ unsigned long millis() {
 	return __millis;
 }
 
+unsigned long micros() {
+	return __millis * 1000;
+}
+
 void delay(unsigned long millis) {
 	__millis += millis;
 }
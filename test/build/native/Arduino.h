@@ -164,6 +164,7 @@ private:
 extern NativeConsole Serial;
 
 unsigned long millis();
+unsigned long micros();
 
 void delay(unsigned long millis);
 
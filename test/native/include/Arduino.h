@@ -31,11 +31,30 @@ class __FlashStringHelper;
 #define FPSTR(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
 #define F(string_literal) (FPSTR(PSTR(string_literal)))
 
-#define vsnprintf_P vsnprintf
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+
+/* Convert %S (flash string) to %s because it means wide string on Linux */
+static __attribute__((unused)) int vsnprintf_P(char *str, size_t size, const char *format, va_list ap) {
+	std::string native_format{format};
+
+	for (size_t i = 0; i + 1 < native_format.length(); i++) {
+		if (native_format[i] == '%') {
+			if (native_format[i + 1] == 'S') {
+				native_format[i + 1] = 's';
+			}
+			i++;
+		}
+	}
+
+	return vsnprintf(str, size, native_format.c_str(), ap);
+}
 
 #define pgm_read_byte(addr) (*reinterpret_cast<const char *>(addr))
 
 static __attribute__((unused)) void yield(void) {}
+unsigned long micros();
 
 class Print {
 public:
@@ -48,6 +67,7 @@ public:
 	size_t println() { return print("\r\n"); }
 	size_t println(const char *data) { return print(data) + println(); }
 	size_t println(const __FlashStringHelper *data) { return print(reinterpret_cast<const char *>(data)) + println(); }
+	virtual int availableForWrite() { return 0; }
 	virtual void flush() { };
 };
 
@@ -56,6 +76,21 @@ public:
 	virtual int available() { return 1; }
 	virtual int read() { return '\n'; }
 	virtual int peek() { return '\n'; }
+	virtual size_t readBytes(char *buffer, size_t length) {
+		size_t count = 0;
+
+		while (count < length) {
+			int c = read();
+
+			if (c < 0) {
+				break;
+			}
+
+			buffer[count++] = c;
+		}
+
+		return count;
+	}
 };
 
 #endif
@@ -0,0 +1,156 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEAP_TRACKER_H_
+#define HEAP_TRACKER_H_
+
+/*
+ * Replacement of the global operator new and operator delete that counts
+ * allocations and the number of bytes allocated.
+ *
+ * This defines the replacement functions so it must only be included
+ * from one file in each test program.
+ *
+ * Every allocation is counted in the global account. While a Scope
+ * exists, allocations are also counted in the account of that scope
+ * and the memory is attributed to it until it is freed (which may be
+ * outside of the scope). An account must outlive all of the memory
+ * attributed to it.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace heap_tracker {
+
+struct Account {
+	unsigned long allocations = 0;
+	unsigned long deallocations = 0;
+	size_t live_bytes = 0;
+	size_t peak_bytes = 0;
+
+	void allocated(size_t size) {
+		allocations++;
+		live_bytes += size;
+		if (live_bytes > peak_bytes) {
+			peak_bytes = live_bytes;
+		}
+	}
+
+	void deallocated(size_t size) {
+		deallocations++;
+		live_bytes -= size;
+	}
+
+	void report(const char *name) const {
+		std::printf("heap: %s allocations=%lu deallocations=%lu live_bytes=%zu peak_bytes=%zu\n",
+			name, allocations, deallocations, live_bytes, peak_bytes);
+		std::fflush(stdout);
+	}
+};
+
+static Account global_account;
+static Account *current_account = nullptr;
+
+/*
+ * Attribute allocations to an account for the lifetime of the scope.
+ */
+class Scope {
+public:
+	explicit Scope(Account &account) : previous_(current_account) {
+		current_account = &account;
+	}
+
+	~Scope() {
+		current_account = previous_;
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+private:
+	Account *previous_;
+};
+
+/*
+ * Count the number of allocations made by a function.
+ */
+template <class Function>
+static unsigned long allocations(Function function) {
+	unsigned long before = global_account.allocations;
+
+	function();
+	return global_account.allocations - before;
+}
+
+struct Header {
+	size_t size;
+	Account *account;
+};
+
+union alignas(alignof(std::max_align_t)) AlignedHeader {
+	Header header;
+	std::max_align_t align;
+};
+
+} // namespace heap_tracker
+
+void *operator new(size_t size) {
+	auto header = static_cast<heap_tracker::AlignedHeader *>(std::malloc(sizeof(heap_tracker::AlignedHeader) + size));
+
+	if (!header) {
+		throw std::bad_alloc{};
+	}
+
+	header->header.size = size;
+	header->header.account = heap_tracker::current_account;
+
+	heap_tracker::global_account.allocated(size);
+	if (header->header.account) {
+		header->header.account->allocated(size);
+	}
+
+	return header + 1;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	if (!ptr) {
+		return;
+	}
+
+	auto header = static_cast<heap_tracker::AlignedHeader *>(ptr) - 1;
+
+	heap_tracker::global_account.deallocated(header->header.size);
+	if (header->header.account) {
+		header->header.account->deallocated(header->header.size);
+	}
+
+	std::free(header);
+}
+
+void operator delete[](void *ptr) noexcept {
+	operator delete(ptr);
+}
+
+#endif
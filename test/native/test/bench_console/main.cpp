@@ -0,0 +1,376 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks for finding, executing and completing commands, parsing
+ * command lines and outputting log messages.
+ *
+ * Each result is output as one line of JSON so that the results from
+ * before and after a change can be compared:
+ *
+ * {"benchmark":"execute_command","commands":100,"indexed":false,"iterations":...,"ns_per_op":...,"allocs_per_op":...}
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <uuid/console.h>
+
+#include <heap_tracker.h>
+
+using ::uuid::flash_string_vector;
+using ::uuid::console::CommandLine;
+using ::uuid::console::Commands;
+using ::uuid::console::Shell;
+
+static constexpr auto MINIMUM_DURATION = std::chrono::milliseconds(20);
+static constexpr unsigned int CONTEXTS = 4;
+static constexpr size_t LOG_BATCH_SIZE = 16;
+
+class NullStream: public Stream {
+public:
+	NullStream() = default;
+	~NullStream() override = default;
+
+	int available() override { return 0; }
+	int read() override { return -1; }
+	int peek() override { return -1; }
+	size_t write(uint8_t data __attribute__((unused))) override { written_++; return 1; }
+	size_t write(const uint8_t *buffer __attribute__((unused)), size_t size) override { written_ += size; return size; }
+
+	size_t written() const { return written_; }
+
+private:
+	size_t written_ = 0;
+};
+
+namespace uuid {
+
+uint64_t get_uptime_ms() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+namespace log {
+
+Message::Message(uint64_t uptime_ms, Level level, Facility facility, const __FlashStringHelper *name, const std::string &&text)
+		: uptime_ms(uptime_ms), level(level), facility(facility), name(name), text(std::move(text)) {
+
+}
+
+} // namespace log
+
+} // namespace uuid
+
+unsigned long micros() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * Synthetic set of commands with multi-word names, spread across
+ * several contexts:
+ *
+ * group<a> item<b> command<n> [value]
+ */
+class CommandSet {
+public:
+	CommandSet(size_t count, bool indexed) : count_(count) {
+		for (size_t i = 0; i < count; i++) {
+			flash_string_vector name{
+				flash(std::string{"group"} + std::to_string(i % 10)),
+				flash(std::string{"item"} + std::to_string((i / 10) % 10)),
+				flash(std::string{"command"} + std::to_string(i)),
+			};
+
+			commands_->add_command(i % CONTEXTS, 0, name, flash_string_vector{F("[value]")},
+				[] (Shell &shell __attribute__((unused)), std::vector<std::string> &arguments __attribute__((unused))) {});
+		}
+
+		if (indexed) {
+			commands_->build_index();
+		}
+	}
+
+	std::shared_ptr<Commands> &commands() {
+		return commands_;
+	}
+
+	/*
+	 * Full command line of a command in context 0 in the middle of the
+	 * set, with one argument.
+	 */
+	std::string line(size_t position) const {
+		size_t i = (position / CONTEXTS) * CONTEXTS;
+
+		return std::string{"group"} + std::to_string(i % 10)
+			+ " item" + std::to_string((i / 10) % 10)
+			+ " command" + std::to_string(i) + " value";
+	}
+
+	size_t count() const {
+		return count_;
+	}
+
+private:
+	const __FlashStringHelper *flash(std::string &&text) {
+		names_.push_back(std::move(text));
+		return reinterpret_cast<const __FlashStringHelper *>(names_.back().c_str());
+	}
+
+	size_t count_;
+	std::deque<std::string> names_;
+	std::shared_ptr<Commands> commands_ = std::make_shared<Commands>();
+};
+
+struct Result {
+	unsigned long iterations;
+	double ns_per_op;
+	double allocs_per_op;
+};
+
+/*
+ * Run an operation repeatedly until the minimum duration has elapsed and
+ * then report the average time and number of allocations for each
+ * operation.
+ */
+template <class Operation>
+static Result measure(Operation operation) {
+	unsigned long iterations = 0;
+	unsigned long batch = 1;
+	std::chrono::steady_clock::duration elapsed{0};
+	unsigned long allocated = 0;
+
+	// Warm up any caches before measuring
+	operation();
+
+	while (elapsed < MINIMUM_DURATION) {
+		unsigned long start_allocations = heap_tracker::global_account.allocations;
+		auto start = std::chrono::steady_clock::now();
+
+		for (unsigned long i = 0; i < batch; i++) {
+			operation();
+		}
+
+		elapsed += std::chrono::steady_clock::now() - start;
+		allocated += heap_tracker::global_account.allocations - start_allocations;
+		iterations += batch;
+		batch *= 2;
+	}
+
+	return Result{iterations,
+		std::chrono::duration<double, std::nano>(elapsed).count() / iterations,
+		static_cast<double>(allocated) / iterations};
+}
+
+static void report(const char *benchmark, const std::string &parameters, const Result &result) {
+	std::printf("{\"benchmark\":\"%s\",%s,\"iterations\":%lu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n",
+		benchmark, parameters.c_str(), result.iterations, result.ns_per_op, result.allocs_per_op);
+	std::fflush(stdout);
+}
+
+static std::string command_parameters(const CommandSet &set, bool indexed) {
+	return std::string{"\"commands\":"} + std::to_string(set.count())
+		+ ",\"indexed\":" + (indexed ? "true" : "false");
+}
+
+static const size_t command_counts[] = { 10, 100, 1000 };
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void bench_execute_command() {
+	for (auto indexed : { false, true }) {
+		for (auto count : command_counts) {
+			NullStream stream;
+			CommandSet set{count, indexed};
+			Shell shell{stream, set.commands()};
+			std::string line = set.line(count / 2);
+
+			report("execute_command", command_parameters(set, indexed), measure([&] {
+				auto execution = set.commands()->execute_command(shell, CommandLine{line});
+
+				TEST_ASSERT_NULL(execution.error);
+			}));
+		}
+	}
+}
+
+static void bench_execute_command_not_found() {
+	for (auto indexed : { false, true }) {
+		for (auto count : command_counts) {
+			NullStream stream;
+			CommandSet set{count, indexed};
+			Shell shell{stream, set.commands()};
+
+			report("execute_command_not_found", command_parameters(set, indexed), measure([&] {
+				auto execution = set.commands()->execute_command(shell, CommandLine{"group1 item1 missing"});
+
+				TEST_ASSERT_NOT_NULL(execution.error);
+			}));
+		}
+	}
+}
+
+static void bench_complete_command_unique() {
+	for (auto indexed : { false, true }) {
+		for (auto count : command_counts) {
+			NullStream stream;
+			CommandSet set{count, indexed};
+			Shell shell{stream, set.commands()};
+			std::string line = set.line(count / 2);
+
+			// Partial last word of the command name
+			line.resize(line.rfind(' ') - 1);
+
+			report("complete_command_unique", command_parameters(set, indexed), measure([&] {
+				auto completion = set.commands()->complete_command(shell, CommandLine{line});
+
+				TEST_ASSERT_FALSE(completion.replacement->empty());
+			}));
+		}
+	}
+}
+
+static void bench_complete_command_ambiguous() {
+	for (auto indexed : { false, true }) {
+		for (auto count : command_counts) {
+			NullStream stream;
+			CommandSet set{count, indexed};
+			Shell shell{stream, set.commands()};
+
+			report("complete_command_ambiguous", command_parameters(set, indexed), measure([&] {
+				set.commands()->complete_command(shell, CommandLine{"group"});
+			}));
+		}
+	}
+}
+
+static void bench_command_line_parse() {
+	static const char *const lines[] = {
+		"command",
+		"group1 item2 command12 value",
+		"set \"quoted value\" with\\ escaped\\ spaces and several more arguments",
+	};
+
+	for (auto line : lines) {
+		std::string text{line};
+
+		report("command_line_parse", std::string{"\"length\":"} + std::to_string(text.length()), measure([&] {
+			CommandLine command_line{text};
+
+			TEST_ASSERT_FALSE(command_line->empty());
+		}));
+	}
+}
+
+static void bench_command_line_to_string() {
+	static const char *const lines[] = {
+		"command",
+		"group1 item2 command12 value",
+		"set \"quoted value\" with\\ escaped\\ spaces and several more arguments",
+	};
+
+	for (auto line : lines) {
+		CommandLine command_line{line};
+
+		report("command_line_to_string", std::string{"\"length\":"} + std::to_string(std::string{line}.length()), measure([&] {
+			TEST_ASSERT_FALSE(command_line.to_string().empty());
+		}));
+	}
+}
+
+/*
+ * Output log messages to each shell from its own queue or from a
+ * shared queue.
+ */
+static void output_logs(const char *benchmark, bool shared) {
+	for (size_t count = 1; count <= 8; count++) {
+		auto queue = shared ? std::make_shared<Shell::SharedLogQueue>(LOG_BATCH_SIZE) : nullptr;
+		std::vector<std::unique_ptr<NullStream>> streams;
+		std::vector<std::shared_ptr<Shell>> shells;
+
+		for (size_t i = 0; i < count; i++) {
+			streams.emplace_back(new NullStream{});
+			shells.push_back(std::make_shared<Shell>(*streams.back(), std::make_shared<Commands>()));
+			shells.back()->shared_log_queue(queue);
+			shells.back()->start();
+		}
+
+		// Each operation is one batch of new messages sent to every shell
+		auto result = measure([&] {
+			for (size_t i = 0; i < LOG_BATCH_SIZE; i++) {
+				auto message = std::make_shared<uuid::log::Message>(i, uuid::log::Level::INFO,
+					uuid::log::Facility::LPR, F("bench"), std::string{"Log message number "} + std::to_string(i));
+
+				if (queue) {
+					*queue << message;
+				} else {
+					for (auto &shell : shells) {
+						*shell << message;
+					}
+				}
+			}
+
+			Shell::loop_all();
+		});
+
+		// Report the time for each message rather than each batch
+		result.ns_per_op /= LOG_BATCH_SIZE;
+		result.allocs_per_op /= LOG_BATCH_SIZE;
+		result.iterations *= LOG_BATCH_SIZE;
+		report(benchmark, std::string{"\"shells\":"} + std::to_string(count), result);
+
+		for (auto &stream : streams) {
+			TEST_ASSERT_TRUE(stream->written() > 0);
+		}
+
+		for (auto &shell : shells) {
+			shell->stop();
+		}
+		Shell::loop_all();
+	}
+}
+
+static void bench_output_logs() {
+	output_logs("output_logs", false);
+}
+
+static void bench_output_logs_shared() {
+	output_logs("output_logs_shared", true);
+}
+
+int main(int argc, char *argv[]) {
+	UNITY_BEGIN();
+	RUN_TEST(bench_execute_command);
+	RUN_TEST(bench_execute_command_not_found);
+	RUN_TEST(bench_complete_command_unique);
+	RUN_TEST(bench_complete_command_ambiguous);
+	RUN_TEST(bench_command_line_parse);
+	RUN_TEST(bench_command_line_to_string);
+	RUN_TEST(bench_output_logs);
+	RUN_TEST(bench_output_logs_shared);
+	return UNITY_END();
+}
@@ -27,6 +27,7 @@
 #include <uuid/console.h>
 
 using ::uuid::console::CommandLine;
+using ::uuid::console::LineBuffer;
 
 namespace uuid {
 
@@ -37,6 +38,11 @@ uint64_t get_uptime_ms() {
 
 } // namespace uuid
 
+unsigned long micros() {
+	static unsigned long micros = 0;
+	return ++micros;
+}
+
 /**
  * Empty string.
  */
@@ -723,6 +729,104 @@ static void test_empty_args_single_quotes7() {
 	TEST_ASSERT_EQUAL_STRING("command \"\"", command_line.to_string().c_str());
 }
 
+/**
+ * Command lines can be parsed from a buffer that is not null terminated.
+ */
+static void test_parse_length() {
+	CommandLine command_line("test 1 2 3", 6);
+
+	TEST_ASSERT_EQUAL_INT(2, command_line->size());
+	if (command_line->size() == 2) {
+		auto it = command_line->begin();
+		TEST_ASSERT_EQUAL_STRING("test", (*it++).c_str());
+		TEST_ASSERT_EQUAL_STRING("1", (*it++).c_str());
+	}
+	TEST_ASSERT_FALSE(command_line.trailing_space);
+}
+
+/**
+ * Line buffers have a fixed capacity.
+ */
+static void test_line_buffer_capacity() {
+	LineBuffer buffer;
+
+	TEST_ASSERT_EQUAL_INT(0, buffer.capacity());
+	TEST_ASSERT_TRUE(buffer.empty());
+	TEST_ASSERT_EQUAL_STRING("", buffer.c_str());
+	TEST_ASSERT_FALSE(buffer.push_back('a'));
+
+	buffer.capacity(4);
+	TEST_ASSERT_EQUAL_INT(4, buffer.capacity());
+	TEST_ASSERT_TRUE(buffer.push_back('a'));
+	TEST_ASSERT_TRUE(buffer.push_back('b'));
+	TEST_ASSERT_TRUE(buffer.push_back('c'));
+	TEST_ASSERT_TRUE(buffer.push_back('d'));
+	TEST_ASSERT_FALSE(buffer.push_back('e'));
+	TEST_ASSERT_EQUAL_INT(4, buffer.length());
+	TEST_ASSERT_EQUAL_STRING("abcd", buffer.c_str());
+
+	buffer.capacity(2);
+	TEST_ASSERT_EQUAL_INT(2, buffer.capacity());
+	TEST_ASSERT_EQUAL_STRING("ab", buffer.c_str());
+
+	buffer.capacity(8);
+	TEST_ASSERT_EQUAL_STRING("ab", buffer.c_str());
+	TEST_ASSERT_EQUAL_STRING("ab", buffer.str().c_str());
+}
+
+/**
+ * Line buffers can be edited.
+ */
+static void test_line_buffer_edit() {
+	LineBuffer buffer;
+
+	buffer.capacity(10);
+	buffer.assign("one two three", 13);
+	TEST_ASSERT_EQUAL_INT(10, buffer.length());
+	TEST_ASSERT_EQUAL_STRING("one two th", buffer.c_str());
+
+	TEST_ASSERT_EQUAL_INT(7, buffer.find_last_of(' '));
+	TEST_ASSERT_EQUAL_INT(std::string::npos, buffer.find_last_of('x'));
+
+	buffer.resize(7);
+	TEST_ASSERT_EQUAL_STRING("one two", buffer.c_str());
+	buffer.resize(8);
+	TEST_ASSERT_EQUAL_STRING("one two", buffer.c_str());
+
+	buffer.pop_back();
+	TEST_ASSERT_EQUAL_STRING("one tw", buffer.c_str());
+
+	buffer.clear();
+	TEST_ASSERT_TRUE(buffer.empty());
+	TEST_ASSERT_EQUAL_STRING("", buffer.c_str());
+	buffer.pop_back();
+	TEST_ASSERT_EQUAL_STRING("", buffer.c_str());
+}
+
+/**
+ * Command lines can be formatted into a line buffer, replacing the
+ * existing contents if they fit.
+ */
+static void test_line_buffer_to_string() {
+	CommandLine command_line("command \"with spaces\" ");
+	LineBuffer buffer;
+
+	buffer.capacity(32);
+	buffer.assign("previous", 8);
+	TEST_ASSERT_TRUE(command_line.to_string(buffer));
+	TEST_ASSERT_EQUAL_STRING("command with\\ spaces ", buffer.c_str());
+
+	buffer.capacity(21);
+	buffer.assign("previous", 8);
+	TEST_ASSERT_TRUE(command_line.to_string(buffer));
+	TEST_ASSERT_EQUAL_STRING("command with\\ spaces ", buffer.c_str());
+
+	buffer.capacity(20);
+	buffer.assign("previous", 8);
+	TEST_ASSERT_FALSE(command_line.to_string(buffer));
+	TEST_ASSERT_EQUAL_STRING("previous", buffer.c_str());
+}
+
 int main(int argc, char *argv[]) {
 	UNITY_BEGIN();
 	RUN_TEST(test_empty);
@@ -773,5 +877,11 @@ int main(int argc, char *argv[]) {
 	RUN_TEST(test_empty_args_single_quotes6);
 	RUN_TEST(test_empty_args_single_quotes7);
 
+	RUN_TEST(test_parse_length);
+
+	RUN_TEST(test_line_buffer_capacity);
+	RUN_TEST(test_line_buffer_edit);
+	RUN_TEST(test_line_buffer_to_string);
+
 	return UNITY_END();
 }
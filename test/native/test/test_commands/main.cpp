@@ -48,6 +48,11 @@ uint64_t get_uptime_ms() {
 
 } // namespace uuid
 
+unsigned long micros() {
+	static unsigned long micros = 0;
+	return ++micros;
+}
+
 static Commands commands;
 static TestStream stream;
 static Shell shell{stream, std::make_shared<Commands>()};
@@ -3414,6 +3419,688 @@ static void test_completion16n() {
 	TEST_ASSERT_EQUAL_STRING("", complete_next.to_string().c_str());
 }
 
+static void add_index_commands(Commands &index_commands) {
+	static const std::vector<std::pair<unsigned int,flash_string_vector>> names{
+		{0, {F("show")}},
+		{0, {F("show"), F("thing1")}},
+		{0, {F("show"), F("thing2")}},
+		{0, {F("show"), F("things")}},
+		{0, {F("shutdown")}},
+		{0, {F("set"), F("hostname")}},
+		{0, {F("set"), F("host")}},
+		{0, {F("set"), F("hostname")}},
+		{0, {F("x"), F("y"), F("z")}},
+		{0, {}},
+		{1, {F("show")}},
+		{1, {F("show"), F("thing1")}},
+		{1, {F("exit")}},
+	};
+	unsigned int flags = 0;
+
+	for (auto &name : names) {
+		std::string text = std::to_string(name.first) + ":" + std::to_string(flags) + ":" + std::to_string(flags >> 2);
+
+		for (auto component : name.second) {
+			text += " " + uuid::read_flash_string(component);
+		}
+
+		index_commands.add_command(name.first, flags & 3, flags >> 2, name.second, flash_string_vector{F("[arg]")},
+				[text] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+			run = text;
+		});
+
+		flags = (flags + 1) % 12;
+	}
+}
+
+/**
+ * The index of command names finds the same commands as searching every command,
+ * taking account of contexts and flags.
+ */
+static void test_index() {
+	static const std::vector<std::string> lines{
+		"", " ", "s", "s ", "sh", "show", "show ", "show t", "show thing", "show thing1",
+		"show thing1 ", "show thing1 a", "show things", "show  ", "show x", "sh t", "sh t ",
+		"shutdown", "shutdown ", "set", "set ", "set host", "set host ", "set hostname x",
+		"x", "x y", "x y z", "x y z a", "x  z", "e", "exit", "exit now", "q", "q r",
+	};
+	auto unindexed_commands = std::make_shared<Commands>();
+	auto indexed_commands = std::make_shared<Commands>();
+
+	add_index_commands(*unindexed_commands);
+	add_index_commands(*indexed_commands);
+	indexed_commands->build_index();
+
+	for (unsigned int context = 0; context <= 2; context++) {
+		for (unsigned int flags = 0; flags < 16; flags++) {
+			Shell unindexed_shell{stream, unindexed_commands, context, flags};
+			Shell indexed_shell{stream, indexed_commands, context, flags};
+
+			for (auto &line : lines) {
+				std::string message = std::to_string(context) + "/" + std::to_string(flags) + " \"" + line + "\"";
+				auto unindexed_completion = unindexed_commands->complete_command(unindexed_shell, CommandLine(line.c_str()));
+				auto indexed_completion = indexed_commands->complete_command(indexed_shell, CommandLine(line.c_str()));
+
+				TEST_ASSERT_EQUAL_STRING_MESSAGE(unindexed_completion.replacement.to_string().c_str(),
+					indexed_completion.replacement.to_string().c_str(), message.c_str());
+				TEST_ASSERT_EQUAL_INT_MESSAGE(unindexed_completion.help.size(), indexed_completion.help.size(), message.c_str());
+
+				for (auto unindexed_it = unindexed_completion.help.cbegin(), indexed_it = indexed_completion.help.cbegin();
+						unindexed_it != unindexed_completion.help.cend(); unindexed_it++, indexed_it++) {
+					TEST_ASSERT_EQUAL_STRING_MESSAGE(unindexed_it->to_string().c_str(), indexed_it->to_string().c_str(), message.c_str());
+				}
+
+				run = "";
+				auto unindexed_execution = unindexed_commands->execute_command(unindexed_shell, CommandLine(line.c_str()));
+				std::string unindexed_run = run;
+
+				run = "";
+				auto indexed_execution = indexed_commands->execute_command(indexed_shell, CommandLine(line.c_str()));
+
+				TEST_ASSERT_EQUAL_PTR_MESSAGE(unindexed_execution.error, indexed_execution.error, message.c_str());
+				TEST_ASSERT_EQUAL_STRING_MESSAGE(unindexed_run.c_str(), run.c_str(), message.c_str());
+			}
+		}
+	}
+
+	// Adding a command discards the index
+	indexed_commands->add_command(flash_string_vector{F("shows")},
+			[] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+		run = "shows";
+	});
+
+	Shell indexed_shell{stream, indexed_commands};
+	auto execution = indexed_commands->execute_command(indexed_shell, CommandLine("shows"));
+
+	TEST_ASSERT_NULL(execution.error);
+	TEST_ASSERT_EQUAL_STRING("shows", run.c_str());
+}
+
+/**
+ * Available commands provide the names and arguments of commands
+ * as flash strings or as strings.
+ */
+static void test_available_commands() {
+	auto available_commands = std::make_shared<Commands>();
+
+	add_index_commands(*available_commands);
+
+	Shell available_shell{stream, available_commands, 0, 3};
+	std::vector<std::string> names;
+
+	for (auto &available_command : available_shell.available_commands()) {
+		std::string name;
+
+		TEST_ASSERT_EQUAL_INT(available_command.flash_name().size(), available_command.name().size());
+		TEST_ASSERT_EQUAL_INT(1, available_command.flash_arguments().size());
+		TEST_ASSERT_EQUAL_INT(1, available_command.arguments().size());
+		TEST_ASSERT_EQUAL_STRING("[arg]", available_command.arguments()[0].c_str());
+
+		for (size_t i = 0; i < available_command.name().size(); i++) {
+			TEST_ASSERT_EQUAL_STRING(uuid::read_flash_string(available_command.flash_name()[i]).c_str(),
+				available_command.name()[i].c_str());
+			name += " " + available_command.name()[i];
+		}
+
+		names.push_back(name);
+	}
+
+	// Commands with not_flags 1 or 2 are unavailable
+	TEST_ASSERT_EQUAL_INT(4, names.size());
+	TEST_ASSERT_EQUAL_STRING(" show", names[0].c_str());
+	TEST_ASSERT_EQUAL_STRING(" show thing1", names[1].c_str());
+	TEST_ASSERT_EQUAL_STRING(" show thing2", names[2].c_str());
+	TEST_ASSERT_EQUAL_STRING(" show things", names[3].c_str());
+
+	auto it = available_shell.available_commands().end();
+
+	it--;
+	TEST_ASSERT_EQUAL_STRING("things", it->name()[1].c_str());
+	TEST_ASSERT_EQUAL_STRING("things", uuid::read_flash_string((*it).flash_name()[1]).c_str());
+	it--;
+	TEST_ASSERT_EQUAL_STRING("thing2", uuid::read_flash_string(it->flash_name()[1]).c_str());
+	TEST_ASSERT_EQUAL_STRING("thing2", it->name()[1].c_str());
+}
+
+/**
+ * Allocations from a scratch arena reuse the same memory block.
+ */
+static void test_scratch_arena() {
+	uuid::console::ScratchArena arena;
+
+	// There is no memory block by default
+	void *heap = arena.allocate(16, 1);
+	TEST_ASSERT_NOT_NULL(heap);
+	arena.deallocate(heap, 16);
+
+	arena.size(64);
+	TEST_ASSERT_EQUAL_INT(64, arena.size());
+
+	uint8_t *a = static_cast<uint8_t*>(arena.allocate(10, 1));
+	uint8_t *b = static_cast<uint8_t*>(arena.allocate(8, 8));
+	TEST_ASSERT_EQUAL_INT(16, b - a);
+	TEST_ASSERT_EQUAL_INT(0, reinterpret_cast<uintptr_t>(b) % 8);
+
+	// Releasing the most recent allocation makes it available again
+	arena.deallocate(b, 8);
+	uint8_t *c = static_cast<uint8_t*>(arena.allocate(4, 4));
+	TEST_ASSERT_EQUAL_PTR(b, c);
+
+	// Allocations that don't fit are made on the heap
+	uint8_t *d = static_cast<uint8_t*>(arena.allocate(64, 1));
+	TEST_ASSERT_TRUE(d < a || d >= a + 64);
+	arena.deallocate(d, 64);
+
+	// Changing the size is deferred until everything has been released
+	arena.size(128);
+	TEST_ASSERT_EQUAL_INT(128, arena.size());
+	uint8_t *e = static_cast<uint8_t*>(arena.allocate(32, 1));
+	TEST_ASSERT_EQUAL_PTR(a + 20, e);
+
+	arena.deallocate(a, 10);
+	arena.deallocate(e, 32);
+	arena.deallocate(c, 4);
+
+	// The whole block is available again
+	uint8_t *f = static_cast<uint8_t*>(arena.allocate(128, 1));
+	TEST_ASSERT_NOT_NULL(f);
+	arena.deallocate(f, 128);
+
+	uuid::console::ScratchAllocator<int> allocator{&arena};
+	std::vector<int,uuid::console::ScratchAllocator<int>> values{allocator};
+
+	for (int i = 0; i < 10; i++) {
+		values.push_back(i);
+	}
+	TEST_ASSERT_EQUAL_INT(9, values.back());
+}
+
+/**
+ * Commands added to contexts in any order are kept in the order they
+ * were added within each context.
+ */
+static void test_context_order() {
+	auto context_commands = std::make_shared<Commands>();
+	auto noop = [] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {};
+
+	context_commands->add_command(2, 0, 0, flash_string_vector{F("two"), F("a")}, noop);
+	context_commands->add_command(1, 0, 0, flash_string_vector{F("one"), F("a")}, noop);
+	context_commands->add_command(2, 0, 0, flash_string_vector{F("two"), F("b")}, noop);
+	context_commands->add_command(0, 0, 0, flash_string_vector{F("zero"), F("a")}, noop);
+	context_commands->add_command(1, 0, 0, flash_string_vector{F("one"), F("b")}, noop);
+	context_commands->add_command(2, 0, 0, flash_string_vector{F("two"), F("c")}, noop);
+
+	for (int pass = 0; pass < 2; pass++) {
+		const char *expected[][3] = {
+			{ "zero a", nullptr, nullptr },
+			{ "one a", "one b", nullptr },
+			{ "two a", "two b", "two c" },
+		};
+
+		for (unsigned int context = 0; context < 4; context++) {
+			Shell context_shell{stream, context_commands, context};
+			size_t count = 0;
+
+			for (auto &available_command : context_shell.available_commands()) {
+				std::string name = available_command.name()[0] + " " + available_command.name()[1];
+
+				TEST_ASSERT_TRUE(context < 3);
+				TEST_ASSERT_TRUE(count < 3);
+				TEST_ASSERT_EQUAL_STRING(expected[context][count], name.c_str());
+				count++;
+			}
+
+			TEST_ASSERT_TRUE(context == 3 || count == 3 || expected[context][count] == nullptr);
+		}
+
+		context_commands->compact();
+	}
+}
+
+/**
+ * Commands added while a command is being executed are available after
+ * it returns.
+ */
+static void test_add_while_executing() {
+	auto add_commands = std::make_shared<Commands>();
+	Shell add_shell{stream, add_commands};
+	unsigned int added = 0;
+
+	add_commands->add_command(flash_string_vector{F("add")},
+		[&] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+			// Enough commands for the storage to be reallocated
+			for (int i = 0; i < 64; i++) {
+				add_commands->add_command(flash_string_vector{F("added")},
+					[&] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+						added++;
+					});
+			}
+
+			auto execution = add_commands->execute_command(shell, CommandLine{"added"});
+			TEST_ASSERT_EQUAL_STRING("Command not found", execution.error);
+			add_commands->compact();
+		});
+
+	auto execution = add_commands->execute_command(add_shell, CommandLine{"add"});
+	TEST_ASSERT_NULL(execution.error);
+	TEST_ASSERT_EQUAL_INT(0, added);
+
+	execution = add_commands->execute_command(add_shell, CommandLine{"added"});
+	TEST_ASSERT_EQUAL_STRING("Fatal error (multiple commands found)", execution.error);
+
+	size_t count = 0;
+	for (auto &available_command __attribute__((unused)) : add_shell.available_commands()) {
+		count++;
+	}
+	TEST_ASSERT_EQUAL_INT(65, count);
+}
+
+static const char static_get[] PROGMEM = "get";
+static const char static_set[] PROGMEM = "set";
+static const char static_thing[] PROGMEM = "thing";
+static const char static_value[] PROGMEM = "<value>";
+
+static const __FlashStringHelper * const static_get_name[] PROGMEM = { FPSTR(static_get), nullptr };
+static const __FlashStringHelper * const static_set_name[] PROGMEM = { FPSTR(static_set), FPSTR(static_thing), nullptr };
+static const __FlashStringHelper * const static_set_arguments[] PROGMEM = { FPSTR(static_value), nullptr };
+
+static void static_get_function(Shell &shell __attribute__((unused)), std::vector<std::string> &arguments __attribute__((unused))) {
+	run = "get";
+}
+
+static void static_set_function(Shell &shell __attribute__((unused)), std::vector<std::string> &arguments) {
+	run = "set thing " + arguments[0];
+}
+
+static const std::vector<std::string> static_set_completion(Shell &shell __attribute__((unused)),
+		const std::vector<std::string> &current_arguments __attribute__((unused)),
+		const std::string &next_argument __attribute__((unused))) {
+	return std::vector<std::string>{"on", "off"};
+}
+
+static const Commands::StaticCommand static_commands[] PROGMEM = {
+	{ 1, 0, 0, static_get_name, nullptr, static_get_function, nullptr },
+	{ 0, 0, 0, static_set_name, static_set_arguments, static_set_function, static_set_completion },
+};
+
+/**
+ * Commands from a static command table can be mixed with dynamically
+ * added commands.
+ */
+static void test_static_commands() {
+	auto static_commands_container = std::make_shared<Commands>();
+
+	static_commands_container->add_command(0, 0, 0, flash_string_vector{F("sets")},
+		[] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+			run = "sets";
+		});
+	static_commands_container->add_commands(static_commands);
+
+	for (int pass = 0; pass < 2; pass++) {
+		Shell static_shell{stream, static_commands_container};
+		std::vector<std::string> names;
+
+		for (auto &available_command : static_shell.available_commands()) {
+			std::string name;
+
+			for (auto flash_name : available_command.flash_name()) {
+				name += uuid::read_flash_string(flash_name) + " ";
+			}
+
+			for (auto &argument : available_command.arguments()) {
+				name += argument + " ";
+			}
+
+			names.push_back(name);
+		}
+
+		TEST_ASSERT_EQUAL_INT(2, names.size());
+		TEST_ASSERT_EQUAL_STRING("sets ", names[0].c_str());
+		TEST_ASSERT_EQUAL_STRING("set thing <value> ", names[1].c_str());
+
+		auto completion = static_commands_container->complete_command(static_shell, CommandLine("set thing of"));
+		TEST_ASSERT_EQUAL_STRING("set thing off", completion.replacement.to_string().c_str());
+		TEST_ASSERT_EQUAL_INT(0, completion.help.size());
+
+		run = "";
+		auto execution = static_commands_container->execute_command(static_shell, CommandLine("set thing on"));
+		TEST_ASSERT_NULL(execution.error);
+		TEST_ASSERT_EQUAL_STRING("set thing on", run.c_str());
+
+		run = "";
+		execution = static_commands_container->execute_command(static_shell, CommandLine("get"));
+		TEST_ASSERT_EQUAL_STRING("Command not found", execution.error);
+		TEST_ASSERT_EQUAL_STRING("", run.c_str());
+
+		static_shell.enter_context(1);
+		execution = static_commands_container->execute_command(static_shell, CommandLine("get"));
+		TEST_ASSERT_NULL(execution.error);
+		TEST_ASSERT_EQUAL_STRING("get", run.c_str());
+
+		static_commands_container->build_index();
+	}
+
+	run = "";
+}
+
+static std::string completion_string(const Commands::Completion &completion) {
+	std::string text = completion.replacement.to_string();
+
+	for (auto &help : completion.help) {
+		text += "|" + help.to_string();
+	}
+
+	return text;
+}
+
+/**
+ * Completions refined from the previous completion are the same as
+ * completions found from scratch.
+ */
+static void test_completion_cache() {
+	Commands::CompletionCache cache;
+	std::vector<std::string> lines;
+
+	for (auto &available_command : commands.available_commands(shell)) {
+		std::string line;
+
+		for (auto &name : available_command.name()) {
+			line += name + " ";
+		}
+
+		lines.push_back(line + "cccc1c b");
+		lines.push_back(line.substr(0, line.size() - 1));
+	}
+
+	TEST_ASSERT_TRUE(lines.size() > 10);
+
+	for (auto &line : lines) {
+		for (size_t length = 1; length <= line.size(); length++) {
+			CommandLine command_line{line.substr(0, length)};
+
+			if (command_line->empty()) {
+				continue;
+			}
+
+			auto expected = completion_string(commands.complete_command(shell, command_line));
+
+			for (int repeat = 0; repeat < 2; repeat++) {
+				TEST_ASSERT_EQUAL_STRING_MESSAGE(expected.c_str(),
+					completion_string(commands.complete_command(shell, command_line, &cache)).c_str(),
+					command_line.to_string().c_str());
+			}
+		}
+	}
+}
+
+/**
+ * Argument completion functions are not called again when the
+ * argument being completed is extended.
+ */
+static void test_completion_cache_arguments() {
+	Commands cache_commands;
+	Commands::CompletionCache cache;
+	unsigned int calls = 0;
+	auto noop = [] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {};
+
+	cache_commands.add_command(0, 0, 0, flash_string_vector{F("cmd")}, flash_string_vector{F("<value>")}, noop,
+		[&] (Shell &shell __attribute__((unused)), const std::vector<std::string> &current_arguments __attribute__((unused)),
+				const std::string &next_argument __attribute__((unused))) -> std::vector<std::string> {
+			calls++;
+			return {"abc", "abd", "bcd"};
+		});
+
+	auto completion = cache_commands.complete_command(shell, CommandLine("cmd "), &cache);
+	TEST_ASSERT_EQUAL_STRING("|abc|abd|bcd", completion_string(completion).c_str());
+	TEST_ASSERT_EQUAL_INT(1, calls);
+
+	completion = cache_commands.complete_command(shell, CommandLine("cmd a"), &cache);
+	TEST_ASSERT_EQUAL_STRING("cmd ab|abc|abd", completion_string(completion).c_str());
+	TEST_ASSERT_EQUAL_INT(1, calls);
+
+	completion = cache_commands.complete_command(shell, CommandLine("cmd abd"), &cache);
+	TEST_ASSERT_EQUAL_STRING("", completion_string(completion).c_str());
+	TEST_ASSERT_EQUAL_INT(1, calls);
+
+	// This is not an extension of the previous argument
+	completion = cache_commands.complete_command(shell, CommandLine("cmd b"), &cache);
+	TEST_ASSERT_EQUAL_STRING("cmd bcd", completion_string(completion).c_str());
+	TEST_ASSERT_EQUAL_INT(2, calls);
+
+	// Changing the commands discards the cache
+	cache_commands.add_command(0, 0, 0, flash_string_vector{F("cmd2")}, noop);
+	completion = cache_commands.complete_command(shell, CommandLine("cmd bc"), &cache);
+	TEST_ASSERT_EQUAL_STRING("cmd bcd", completion_string(completion).c_str());
+	TEST_ASSERT_EQUAL_INT(3, calls);
+
+	completion = cache_commands.complete_command(shell, CommandLine("cm"), &cache);
+	TEST_ASSERT_EQUAL_STRING("cmd|cmd <value>|cmd2", completion_string(completion).c_str());
+}
+
+/**
+ * Argument completion stream functions provide values one at a time and
+ * can stop when no more values are needed.
+ */
+static void test_completion_stream() {
+	auto stream_commands = std::make_shared<Commands>();
+	Shell stream_shell{stream, stream_commands};
+	unsigned int provided = 0;
+	auto noop = [] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {};
+
+	stream_commands->add_command(0, 0, 0, flash_string_vector{F("cmd")}, flash_string_vector{F("<value>"), F("[other]")}, noop,
+		[&] (Shell &shell __attribute__((unused)), const std::vector<std::string> &current_arguments __attribute__((unused)),
+				const std::string &next_argument __attribute__((unused)), Commands::ArgumentCompletions &completions) {
+			for (unsigned int i = 0; i < 1000; i++) {
+				char value[16];
+
+				provided++;
+				snprintf(value, sizeof(value), "value%03u", i);
+				if (!completions.add(value)) {
+					break;
+				}
+			}
+		});
+	stream_commands->add_command(0, 0, 0, flash_string_vector{F("old")}, flash_string_vector{F("<value>")}, noop, nullptr);
+
+	auto completion = stream_commands->complete_command(stream_shell, CommandLine("cmd v"));
+	TEST_ASSERT_EQUAL_STRING("cmd value", completion.replacement.to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(1000, completion.help.size());
+	TEST_ASSERT_EQUAL_STRING("value000 [other]", completion.help.front().to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(1000, provided);
+
+	stream_shell.maximum_argument_completions(5);
+	TEST_ASSERT_EQUAL_INT(5, stream_shell.maximum_argument_completions());
+
+	// All of the values are needed to find the longest common prefix
+	provided = 0;
+	completion = stream_commands->complete_command(stream_shell, CommandLine("cmd v"));
+	TEST_ASSERT_EQUAL_STRING("cmd value", completion.replacement.to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(5, completion.help.size());
+	TEST_ASSERT_EQUAL_STRING("value004 [other]", completion.help.back().to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(1000, provided);
+
+	// The common prefix can't get any shorter after "value100"
+	provided = 0;
+	completion = stream_commands->complete_command(stream_shell, CommandLine("cmd value"));
+	TEST_ASSERT_EQUAL_STRING("", completion.replacement.to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(5, completion.help.size());
+	TEST_ASSERT_EQUAL_INT(101, provided);
+
+	provided = 0;
+	completion = stream_commands->complete_command(stream_shell, CommandLine("cmd value12"));
+	TEST_ASSERT_EQUAL_STRING("", completion.replacement.to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(5, completion.help.size());
+	TEST_ASSERT_EQUAL_STRING("value120 [other]", completion.help.front().to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(125, provided);
+
+	completion = stream_commands->complete_command(stream_shell, CommandLine("cmd value123"));
+	TEST_ASSERT_EQUAL_STRING("cmd value123 ", completion.replacement.to_string().c_str());
+	TEST_ASSERT_EQUAL_INT(1, completion.help.size());
+	TEST_ASSERT_EQUAL_STRING("[other]", completion.help.front().to_string().c_str());
+
+	completion = stream_commands->complete_command(stream_shell, CommandLine("old "));
+	TEST_ASSERT_EQUAL_INT(1, completion.help.size());
+	TEST_ASSERT_EQUAL_STRING("<value>", completion.help.front().to_string().c_str());
+}
+
+static void run_tests() {
+	RUN_TEST(test_completion0);
+	RUN_TEST(test_execution0);
+
+	RUN_TEST(test_completion1a);
+	RUN_TEST(test_completion1b);
+	RUN_TEST(test_completion1c);
+	RUN_TEST(test_completion1d);
+	RUN_TEST(test_completion1e);
+	RUN_TEST(test_completion1f);
+	RUN_TEST(test_completion1g);
+	RUN_TEST(test_execution1a);
+	RUN_TEST(test_execution1b);
+	RUN_TEST(test_execution1d);
+	RUN_TEST(test_execution1c);
+	RUN_TEST(test_execution1e);
+	RUN_TEST(test_execution1f);
+	RUN_TEST(test_execution1g);
+
+	RUN_TEST(test_completion2a);
+	RUN_TEST(test_completion2b);
+	RUN_TEST(test_completion2c);
+	RUN_TEST(test_completion2d);
+	RUN_TEST(test_completion2e);
+	RUN_TEST(test_completion2f);
+	RUN_TEST(test_completion2g);
+	RUN_TEST(test_completion2h);
+	RUN_TEST(test_completion2i);
+	RUN_TEST(test_completion2j);
+	RUN_TEST(test_execution2a);
+	RUN_TEST(test_execution2b);
+	RUN_TEST(test_execution2c);
+	RUN_TEST(test_execution2d);
+	RUN_TEST(test_execution2e);
+	RUN_TEST(test_execution2f);
+	RUN_TEST(test_execution2g);
+	RUN_TEST(test_execution2h);
+	RUN_TEST(test_execution2i);
+	RUN_TEST(test_execution2j);
+
+	RUN_TEST(test_completion3a);
+	RUN_TEST(test_completion3b);
+	RUN_TEST(test_completion3c);
+	RUN_TEST(test_execution3a);
+	RUN_TEST(test_execution3b);
+	RUN_TEST(test_execution3c);
+
+	RUN_TEST(test_completion4a);
+	RUN_TEST(test_completion4b);
+	RUN_TEST(test_completion4c);
+	RUN_TEST(test_execution4a);
+	RUN_TEST(test_execution4b);
+	RUN_TEST(test_execution4c);
+
+	RUN_TEST(test_completion5a);
+	RUN_TEST(test_completion5b);
+	RUN_TEST(test_completion5c);
+	RUN_TEST(test_completion5d);
+	RUN_TEST(test_completion5e);
+	RUN_TEST(test_completion5f);
+	RUN_TEST(test_completion5g);
+	RUN_TEST(test_completion5h);
+	RUN_TEST(test_completion5i);
+	RUN_TEST(test_completion5j);
+	RUN_TEST(test_execution5a);
+	RUN_TEST(test_execution5b);
+	RUN_TEST(test_execution5c);
+	RUN_TEST(test_execution5d);
+	RUN_TEST(test_execution5e);
+	RUN_TEST(test_execution5f);
+	RUN_TEST(test_execution5g);
+	RUN_TEST(test_execution5h);
+	RUN_TEST(test_execution5i);
+	RUN_TEST(test_execution5j);
+
+	RUN_TEST(test_completion6a);
+	RUN_TEST(test_completion6b);
+	RUN_TEST(test_completion6c);
+	RUN_TEST(test_execution6a);
+	RUN_TEST(test_execution6b);
+	RUN_TEST(test_execution6c);
+
+	RUN_TEST(test_execution7a);
+	RUN_TEST(test_execution7b);
+
+	RUN_TEST(test_completion8a);
+	RUN_TEST(test_completion8b);
+	RUN_TEST(test_completion8c);
+	RUN_TEST(test_completion8d);
+	RUN_TEST(test_completion8e);
+	RUN_TEST(test_completion8f);
+	RUN_TEST(test_completion8g);
+	RUN_TEST(test_completion8h);
+	RUN_TEST(test_completion8i);
+	RUN_TEST(test_completion8j);
+	RUN_TEST(test_completion8k);
+	RUN_TEST(test_completion8l);
+	RUN_TEST(test_completion8m);
+	RUN_TEST(test_completion8n);
+	RUN_TEST(test_completion8o);
+	RUN_TEST(test_completion8p);
+	RUN_TEST(test_completion8q);
+	RUN_TEST(test_completion8r);
+	RUN_TEST(test_completion8s);
+	RUN_TEST(test_completion8t);
+	RUN_TEST(test_completion8u);
+
+	RUN_TEST(test_completion9a);
+	RUN_TEST(test_completion9b);
+	RUN_TEST(test_completion9c);
+	RUN_TEST(test_completion9d);
+	RUN_TEST(test_completion9e);
+	RUN_TEST(test_completion9f);
+	RUN_TEST(test_completion9g);
+	RUN_TEST(test_completion9h);
+	RUN_TEST(test_completion9i);
+	RUN_TEST(test_completion9j);
+	RUN_TEST(test_completion9k);
+
+	RUN_TEST(test_completion10a);
+	RUN_TEST(test_completion10b);
+	RUN_TEST(test_execution10a);
+
+	RUN_TEST(test_completion11a);
+	RUN_TEST(test_completion11b);
+
+	RUN_TEST(test_completion12a);
+	RUN_TEST(test_completion12b);
+	RUN_TEST(test_completion12c);
+
+	RUN_TEST(test_completion13a);
+	RUN_TEST(test_completion13b);
+	RUN_TEST(test_completion13c);
+
+	RUN_TEST(test_completion14a);
+	RUN_TEST(test_completion14b);
+
+	RUN_TEST(test_completion15a);
+	RUN_TEST(test_completion15b);
+	RUN_TEST(test_completion15c);
+	RUN_TEST(test_completion15d);
+
+	RUN_TEST(test_completion16a);
+	RUN_TEST(test_completion16b);
+	RUN_TEST(test_completion16c);
+	RUN_TEST(test_completion16d);
+	RUN_TEST(test_completion16e);
+	RUN_TEST(test_completion16f);
+	RUN_TEST(test_completion16g);
+	RUN_TEST(test_completion16h);
+	RUN_TEST(test_completion16i);
+	RUN_TEST(test_completion16j);
+	RUN_TEST(test_completion16k);
+	RUN_TEST(test_completion16l);
+	RUN_TEST(test_completion16m);
+	RUN_TEST(test_completion16n);
+}
+
 int main(int argc, char *argv[]) {
 	commands.add_command(0, 0, flash_string_vector{F("help")},
 			[&] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
@@ -3822,161 +4509,26 @@ int main(int argc, char *argv[]) {
 	});
 
 	UNITY_BEGIN();
-	RUN_TEST(test_completion0);
-	RUN_TEST(test_execution0);
-
-	RUN_TEST(test_completion1a);
-	RUN_TEST(test_completion1b);
-	RUN_TEST(test_completion1c);
-	RUN_TEST(test_completion1d);
-	RUN_TEST(test_completion1e);
-	RUN_TEST(test_completion1f);
-	RUN_TEST(test_completion1g);
-	RUN_TEST(test_execution1a);
-	RUN_TEST(test_execution1b);
-	RUN_TEST(test_execution1d);
-	RUN_TEST(test_execution1c);
-	RUN_TEST(test_execution1e);
-	RUN_TEST(test_execution1f);
-	RUN_TEST(test_execution1g);
-
-	RUN_TEST(test_completion2a);
-	RUN_TEST(test_completion2b);
-	RUN_TEST(test_completion2c);
-	RUN_TEST(test_completion2d);
-	RUN_TEST(test_completion2e);
-	RUN_TEST(test_completion2f);
-	RUN_TEST(test_completion2g);
-	RUN_TEST(test_completion2h);
-	RUN_TEST(test_completion2i);
-	RUN_TEST(test_completion2j);
-	RUN_TEST(test_execution2a);
-	RUN_TEST(test_execution2b);
-	RUN_TEST(test_execution2c);
-	RUN_TEST(test_execution2d);
-	RUN_TEST(test_execution2e);
-	RUN_TEST(test_execution2f);
-	RUN_TEST(test_execution2g);
-	RUN_TEST(test_execution2h);
-	RUN_TEST(test_execution2i);
-	RUN_TEST(test_execution2j);
-
-	RUN_TEST(test_completion3a);
-	RUN_TEST(test_completion3b);
-	RUN_TEST(test_completion3c);
-	RUN_TEST(test_execution3a);
-	RUN_TEST(test_execution3b);
-	RUN_TEST(test_execution3c);
-
-	RUN_TEST(test_completion4a);
-	RUN_TEST(test_completion4b);
-	RUN_TEST(test_completion4c);
-	RUN_TEST(test_execution4a);
-	RUN_TEST(test_execution4b);
-	RUN_TEST(test_execution4c);
-
-	RUN_TEST(test_completion5a);
-	RUN_TEST(test_completion5b);
-	RUN_TEST(test_completion5c);
-	RUN_TEST(test_completion5d);
-	RUN_TEST(test_completion5e);
-	RUN_TEST(test_completion5f);
-	RUN_TEST(test_completion5g);
-	RUN_TEST(test_completion5h);
-	RUN_TEST(test_completion5i);
-	RUN_TEST(test_completion5j);
-	RUN_TEST(test_execution5a);
-	RUN_TEST(test_execution5b);
-	RUN_TEST(test_execution5c);
-	RUN_TEST(test_execution5d);
-	RUN_TEST(test_execution5e);
-	RUN_TEST(test_execution5f);
-	RUN_TEST(test_execution5g);
-	RUN_TEST(test_execution5h);
-	RUN_TEST(test_execution5i);
-	RUN_TEST(test_execution5j);
-
-	RUN_TEST(test_completion6a);
-	RUN_TEST(test_completion6b);
-	RUN_TEST(test_completion6c);
-	RUN_TEST(test_execution6a);
-	RUN_TEST(test_execution6b);
-	RUN_TEST(test_execution6c);
-
-	RUN_TEST(test_execution7a);
-	RUN_TEST(test_execution7b);
-
-	RUN_TEST(test_completion8a);
-	RUN_TEST(test_completion8b);
-	RUN_TEST(test_completion8c);
-	RUN_TEST(test_completion8d);
-	RUN_TEST(test_completion8e);
-	RUN_TEST(test_completion8f);
-	RUN_TEST(test_completion8g);
-	RUN_TEST(test_completion8h);
-	RUN_TEST(test_completion8i);
-	RUN_TEST(test_completion8j);
-	RUN_TEST(test_completion8k);
-	RUN_TEST(test_completion8l);
-	RUN_TEST(test_completion8m);
-	RUN_TEST(test_completion8n);
-	RUN_TEST(test_completion8o);
-	RUN_TEST(test_completion8p);
-	RUN_TEST(test_completion8q);
-	RUN_TEST(test_completion8r);
-	RUN_TEST(test_completion8s);
-	RUN_TEST(test_completion8t);
-	RUN_TEST(test_completion8u);
-
-	RUN_TEST(test_completion9a);
-	RUN_TEST(test_completion9b);
-	RUN_TEST(test_completion9c);
-	RUN_TEST(test_completion9d);
-	RUN_TEST(test_completion9e);
-	RUN_TEST(test_completion9f);
-	RUN_TEST(test_completion9g);
-	RUN_TEST(test_completion9h);
-	RUN_TEST(test_completion9i);
-	RUN_TEST(test_completion9j);
-	RUN_TEST(test_completion9k);
-
-	RUN_TEST(test_completion10a);
-	RUN_TEST(test_completion10b);
-	RUN_TEST(test_execution10a);
-
-	RUN_TEST(test_completion11a);
-	RUN_TEST(test_completion11b);
-
-	RUN_TEST(test_completion12a);
-	RUN_TEST(test_completion12b);
-	RUN_TEST(test_completion12c);
-
-	RUN_TEST(test_completion13a);
-	RUN_TEST(test_completion13b);
-	RUN_TEST(test_completion13c);
-
-	RUN_TEST(test_completion14a);
-	RUN_TEST(test_completion14b);
-
-	RUN_TEST(test_completion15a);
-	RUN_TEST(test_completion15b);
-	RUN_TEST(test_completion15c);
-	RUN_TEST(test_completion15d);
-
-	RUN_TEST(test_completion16a);
-	RUN_TEST(test_completion16b);
-	RUN_TEST(test_completion16c);
-	RUN_TEST(test_completion16d);
-	RUN_TEST(test_completion16e);
-	RUN_TEST(test_completion16f);
-	RUN_TEST(test_completion16g);
-	RUN_TEST(test_completion16h);
-	RUN_TEST(test_completion16i);
-	RUN_TEST(test_completion16j);
-	RUN_TEST(test_completion16k);
-	RUN_TEST(test_completion16l);
-	RUN_TEST(test_completion16m);
-	RUN_TEST(test_completion16n);
+	run_tests();
+	RUN_TEST(test_index);
+	RUN_TEST(test_available_commands);
+	RUN_TEST(test_context_order);
+	RUN_TEST(test_add_while_executing);
+	RUN_TEST(test_static_commands);
+	RUN_TEST(test_completion_cache);
+	RUN_TEST(test_completion_cache_arguments);
+	RUN_TEST(test_completion_stream);
+
+	RUN_TEST(test_scratch_arena);
+
+	// Repeat all of the tests using the index
+	commands.compact();
+	commands.build_index();
+	run_tests();
+
+	// Repeat all of the tests using the index and a scratch arena
+	shell.scratch_arena().size(256);
+	run_tests();
 
 	return UNITY_END();
 }
@@ -0,0 +1,465 @@
+/*
+ * uuid-console - Microcontroller console shell
+ * Copyright 2026  Simon Arlott
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include <unity.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <uuid/console.h>
+
+#include <heap_tracker.h>
+
+using ::uuid::flash_string_vector;
+using ::uuid::console::Commands;
+using ::uuid::console::Shell;
+
+/*
+ * Maximum number of allocations to process a command that has been
+ * executed before: parsing the command line and calling the command
+ * function.
+ */
+static constexpr unsigned long PROCESS_COMMAND_BUDGET = 4;
+
+/*
+ * Maximum number of allocations to output a log message that has
+ * already been formatted for another shell.
+ */
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE && UUID_CONSOLE_THREAD_SAFE
+// Every shell formats log messages separately
+static constexpr unsigned long LOG_MESSAGE_BUDGET = 2;
+#else
+static constexpr unsigned long LOG_MESSAGE_BUDGET = 0;
+#endif
+
+class TestStream: public Stream {
+public:
+	TestStream() = default;
+	~TestStream() override = default;
+
+	void operator<<(const std::string &input) {
+		input_data_.insert(input_data_.end(), input.begin(), input.end());
+	}
+
+	bool empty() {
+		return input_data_.empty();
+	}
+
+	std::string output() {
+		std::string copy = output_data_;
+		output_data_.clear();
+		return copy;
+	}
+
+	/*
+	 * Discard output without allocating.
+	 */
+	void clear() {
+		output_data_.clear();
+	}
+
+	void reserve(size_t capacity) {
+		output_data_.reserve(capacity);
+	}
+
+protected:
+	int available() override {
+		return input_data_.size();
+	}
+
+	int read() override {
+		if (input_data_.empty()) {
+			return -1;
+		} else {
+			unsigned char c = input_data_.front();
+
+			input_data_.pop_front();
+			return c;
+		}
+	};
+
+	int peek() override {
+		if (input_data_.empty()) {
+			return -1;
+		} else {
+			return input_data_.front();
+		}
+	};
+
+	size_t write(uint8_t data) override {
+		output_data_ += data;
+		return 1;
+	}
+
+	size_t write(const uint8_t *buffer, size_t size) override {
+		output_data_.append(reinterpret_cast<const char*>(buffer), size);
+		return size;
+	}
+
+private:
+	std::list<unsigned char> input_data_;
+	std::string output_data_;
+};
+
+namespace uuid {
+
+uint64_t get_uptime_ms() {
+	static uint64_t millis = 0;
+	return ++millis;
+}
+
+namespace log {
+
+Message::Message(uint64_t uptime_ms, Level level, Facility facility, const __FlashStringHelper *name, const std::string &&text)
+		: uptime_ms(uptime_ms), level(level), facility(facility), name(name), text(std::move(text)) {
+
+}
+
+} // namespace log
+
+} // namespace uuid
+
+static unsigned long test_micros = 0;
+
+unsigned long micros() {
+	test_micros += 100;
+	return test_micros;
+}
+
+static std::shared_ptr<Commands> commands = std::make_shared<Commands>();
+static unsigned int executed = 0;
+
+/*
+ * Queue input and process it, returns the number of allocations. The
+ * output must have enough capacity reserved already.
+ */
+static unsigned long input(TestStream &stream, Shell &shell, const std::string &text) {
+	unsigned long count = 0;
+
+	for (auto c : text) {
+		// Queuing input for the test allocates
+		stream << std::string(1, c);
+
+		count += heap_tracker::allocations([&] {
+			shell.loop_one();
+		});
+	}
+
+	return count;
+}
+
+void setUp(void) {
+	executed = 0;
+}
+
+void tearDown(void) {
+	// Remove stopped shells
+	Shell::loop_all();
+}
+
+static void prepare(TestStream &stream, Shell &shell) {
+	// Reserve capacity for output so that writes don't allocate
+	stream.reserve(4096);
+
+	shell.start();
+	shell.loop_one();
+	stream.clear();
+}
+
+/**
+ * Echoing keystrokes in loop_normal() must not allocate.
+ */
+static void test_keystroke_echo() {
+	TestStream stream;
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	prepare(stream, *shell);
+
+	TEST_ASSERT_EQUAL_INT(0, input(stream, *shell, "abcdefghij"));
+	TEST_ASSERT_EQUAL_STRING("abcdefghij", stream.output().c_str());
+
+	// Backspace
+	TEST_ASSERT_EQUAL_INT(0, input(stream, *shell, "\x08\x7F"));
+	TEST_ASSERT_EQUAL_STRING("\x08\033[K\x08\033[K", stream.output().c_str());
+
+	shell->stop();
+}
+
+/**
+ * Editing the command line after completing a command must not allocate.
+ */
+static void test_edit_after_completion() {
+	TestStream stream;
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	prepare(stream, *shell);
+
+	input(stream, *shell, "te\t");
+	TEST_ASSERT_EQUAL_STRING("te\033[G\033[K$ test ", stream.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(0, input(stream, *shell, "one two"));
+	TEST_ASSERT_EQUAL_INT(0, input(stream, *shell, "\x17\x08"));
+	TEST_ASSERT_EQUAL_INT(0, input(stream, *shell, std::string(Shell::MAX_COMMAND_LINE_LENGTH, 'x')));
+	TEST_ASSERT_EQUAL_INT(0, input(stream, *shell, "\x15"));
+	stream.clear();
+
+	shell->stop();
+}
+
+/**
+ * Processing a command that has been executed before must not exceed the
+ * allocation budget.
+ */
+static void test_process_command() {
+	TestStream stream;
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	prepare(stream, *shell);
+
+	input(stream, *shell, "test one\r\n");
+	TEST_ASSERT_EQUAL_INT(1, executed);
+	stream.clear();
+
+	unsigned long count = input(stream, *shell, "test two\r\n");
+
+	TEST_ASSERT_EQUAL_INT(2, executed);
+	TEST_ASSERT_LESS_OR_EQUAL(PROCESS_COMMAND_BUDGET, count);
+
+	shell->stop();
+}
+
+/**
+ * Outputting a log message that has already been formatted for another
+ * shell must not exceed the allocation budget.
+ */
+static void test_log_message_output() {
+	TestStream stream1;
+	TestStream stream2;
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+
+	prepare(stream1, *shell1);
+	prepare(stream2, *shell2);
+
+	for (int i = 0; i < 2; i++) {
+		auto message = std::make_shared<uuid::log::Message>(0, uuid::log::Level::INFO, uuid::log::Facility::LPR,
+			F("test"), std::string{"Hello World!"});
+
+		*shell1 << message;
+		*shell2 << message;
+
+		shell1->loop_one();
+		stream1.clear();
+
+		unsigned long count = heap_tracker::allocations([&] {
+			shell2->loop_one();
+		});
+
+		TEST_ASSERT_TRUE(stream2.output().find("Hello World!") != std::string::npos);
+		if (i > 0) {
+			TEST_ASSERT_LESS_OR_EQUAL(LOG_MESSAGE_BUDGET, count);
+		}
+	}
+
+	shell1->stop();
+	shell2->stop();
+}
+
+/**
+ * A formatted log message is freed when every shell has output it.
+ */
+static void test_log_message_released() {
+	TestStream stream1;
+	TestStream stream2;
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+
+	prepare(stream1, *shell1);
+	prepare(stream2, *shell2);
+
+	heap_tracker::Account account;
+
+	{
+		heap_tracker::Scope scope{account};
+		auto message = std::make_shared<uuid::log::Message>(0, uuid::log::Level::INFO, uuid::log::Facility::LPR,
+			F("test"), std::string{"Hello World!"});
+
+		*shell1 << message;
+		*shell2 << message;
+	}
+
+	{
+		heap_tracker::Scope scope{account};
+
+		shell1->loop_one();
+		shell2->loop_one();
+	}
+
+	TEST_ASSERT_TRUE(stream1.output().find("Hello World!") != std::string::npos);
+	TEST_ASSERT_TRUE(stream2.output().find("Hello World!") != std::string::npos);
+	TEST_ASSERT_TRUE(account.allocations > 0);
+	TEST_ASSERT_EQUAL_INT(0, account.live_bytes);
+
+	shell1->stop();
+	shell2->stop();
+}
+
+/**
+ * Outputting log messages from a shared queue must not allocate, no
+ * matter how many shells there are.
+ */
+static void test_shared_log_queue() {
+	auto queue = std::make_shared<Shell::SharedLogQueue>();
+	std::vector<std::unique_ptr<TestStream>> streams;
+	std::vector<std::shared_ptr<Shell>> shells;
+
+	for (int i = 0; i < 8; i++) {
+		streams.emplace_back(new TestStream{});
+		shells.push_back(std::make_shared<Shell>(*streams.back(), commands));
+		shells.back()->shared_log_queue(queue);
+		prepare(*streams.back(), *shells.back());
+	}
+
+	for (int i = 0; i < 2; i++) {
+		auto message = std::make_shared<uuid::log::Message>(0, uuid::log::Level::INFO, uuid::log::Facility::LPR,
+			F("test"), std::string{"Hello World!"});
+
+		*queue << message;
+
+		unsigned long count = heap_tracker::allocations([&] {
+			for (auto &shell : shells) {
+				shell->loop_one();
+			}
+		});
+
+		for (auto &stream : streams) {
+			TEST_ASSERT_TRUE(stream->output().find("Hello World!") != std::string::npos);
+		}
+		if (i > 0) {
+			TEST_ASSERT_EQUAL_INT(0, count);
+		}
+	}
+
+	for (auto &shell : shells) {
+		shell->stop();
+	}
+}
+
+/**
+ * Memory allocated by each shell is all freed when it is destroyed.
+ */
+static void test_shell_accounts() {
+	heap_tracker::Account account1;
+	heap_tracker::Account account2;
+	TestStream stream1;
+	TestStream stream2;
+
+	stream1.reserve(4096);
+	stream2.reserve(4096);
+
+	{
+		std::shared_ptr<Shell> shell1;
+		std::shared_ptr<Shell> shell2;
+
+		{
+			heap_tracker::Scope scope{account1};
+
+			shell1 = std::make_shared<Shell>(stream1, commands);
+			shell1->maximum_command_line_length(64);
+			prepare(stream1, *shell1);
+		}
+
+		{
+			heap_tracker::Scope scope{account2};
+
+			shell2 = std::make_shared<Shell>(stream2, commands);
+			shell2->maximum_command_line_length(256);
+			prepare(stream2, *shell2);
+		}
+
+		for (int i = 0; i < 4; i++) {
+			{
+				heap_tracker::Scope scope{account1};
+
+				input(stream1, *shell1, "test one two three\r\n");
+			}
+
+			{
+				heap_tracker::Scope scope{account2};
+
+				input(stream2, *shell2, "test four five six\r\n");
+			}
+		}
+
+		TEST_ASSERT_EQUAL_INT(8, executed);
+		TEST_ASSERT_TRUE(account1.live_bytes > 0);
+#if !UUID_CONSOLE_LINE_BUFFER_SIZE
+		TEST_ASSERT_TRUE(account2.live_bytes > account1.live_bytes);
+#endif
+		TEST_ASSERT_TRUE(account1.peak_bytes >= account1.live_bytes);
+		TEST_ASSERT_TRUE(account2.peak_bytes >= account2.live_bytes);
+
+		account1.report("shell1");
+		account2.report("shell2");
+
+		shell1->stop();
+		shell2->stop();
+		Shell::loop_all();
+	}
+
+	TEST_ASSERT_EQUAL_INT(0, account1.live_bytes);
+	TEST_ASSERT_EQUAL_INT(0, account2.live_bytes);
+	TEST_ASSERT_EQUAL_INT(account1.allocations, account1.deallocations);
+	TEST_ASSERT_EQUAL_INT(account2.allocations, account2.deallocations);
+}
+
+int main(int argc, char *argv[]) {
+	commands->add_command(flash_string_vector{F("test")}, flash_string_vector{F("[a]"), F("[b]"), F("[c]")},
+		[] (Shell &shell __attribute__((unused)), std::vector<std::string> &arguments __attribute__((unused))) {
+			executed++;
+		});
+
+	// Allocate any memory that is only needed once, for two shells
+	{
+		TestStream stream1;
+		TestStream stream2;
+		auto shell1 = std::make_shared<Shell>(stream1, commands);
+		auto shell2 = std::make_shared<Shell>(stream2, commands);
+
+		prepare(stream1, *shell1);
+		prepare(stream2, *shell2);
+		shell1->stop();
+		shell2->stop();
+		Shell::loop_all();
+	}
+
+	UNITY_BEGIN();
+	RUN_TEST(test_keystroke_echo);
+	RUN_TEST(test_edit_after_completion);
+	RUN_TEST(test_process_command);
+	RUN_TEST(test_log_message_output);
+	RUN_TEST(test_log_message_released);
+	RUN_TEST(test_shared_log_queue);
+	RUN_TEST(test_shell_accounts);
+
+	heap_tracker::global_account.report("total");
+	return UNITY_END();
+}
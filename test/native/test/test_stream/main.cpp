@@ -19,6 +19,8 @@
 #include <Arduino.h>
 #include <unity.h>
 
+#include <algorithm>
+#include <climits>
 #include <list>
 #include <memory>
 #include <string>
@@ -26,6 +28,12 @@
 
 #include <uuid/console.h>
 
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE > 1
+# include <atomic>
+# include <cstdio>
+# include <thread>
+#endif
+
 using ::uuid::flash_string_vector;
 using ::uuid::console::Commands;
 using ::uuid::console::Shell;
@@ -56,12 +64,34 @@ public:
 		return copy;
 	}
 
+	size_t reads() {
+		return reads_;
+	}
+
+	size_t bulk_reads() {
+		return bulk_reads_;
+	}
+
+	void available_for_write(int available) {
+		available_for_write_ = available;
+	}
+
+	/*
+	 * Limit the number of bytes that will be accepted by writes, or -1
+	 * for no limit.
+	 */
+	void write_limit(int limit) {
+		write_limit_ = limit;
+	}
+
 protected:
 	int available() override {
 		return input_data_.size();
 	}
 
 	int read() override {
+		reads_++;
+
 		if (input_data_.empty()) {
 			return -1;
 		} else {
@@ -72,6 +102,19 @@ protected:
 		}
 	};
 
+	size_t readBytes(char *buffer, size_t length) override {
+		size_t count = 0;
+
+		bulk_reads_++;
+
+		while (count < length && !input_data_.empty()) {
+			buffer[count++] = input_data_.front();
+			input_data_.pop_front();
+		}
+
+		return count;
+	}
+
 	int peek() override {
 		if (!supports_peek_ || input_data_.empty()) {
 			return -1;
@@ -80,13 +123,30 @@ protected:
 		}
 	};
 
+	int availableForWrite() override {
+		return available_for_write_;
+	}
+
 	size_t write(uint8_t data) override {
+		if (write_limit_ == 0) {
+			return 0;
+		} else if (write_limit_ > 0) {
+			write_limit_--;
+		}
+
 		output_data_ += data;
+		available_for_write_ = std::max(0, available_for_write_ - 1);
 		return 1;
 	}
 
 	size_t write(const uint8_t *buffer, size_t size) override {
+		if (write_limit_ >= 0) {
+			size = std::min(size, static_cast<size_t>(write_limit_));
+			write_limit_ -= size;
+		}
+
 		output_data_ += std::string(reinterpret_cast<const char*>(buffer), size);
+		available_for_write_ = std::max(0, available_for_write_ - static_cast<int>(size));
 		return size;
 	}
 
@@ -94,6 +154,10 @@ private:
 	std::list<unsigned char> input_data_;
 	std::string output_data_;
 	bool supports_peek_;
+	size_t reads_ = 0;
+	size_t bulk_reads_ = 0;
+	int available_for_write_ = 0;
+	int write_limit_ = -1;
 };
 
 /**
@@ -112,8 +176,28 @@ uint64_t get_uptime_ms() {
 	return ++millis;
 }
 
+namespace log {
+
+Message::Message(uint64_t uptime_ms, Level level, Facility facility, const __FlashStringHelper *name, const std::string &&text)
+		: uptime_ms(uptime_ms), level(level), facility(facility), name(name), text(std::move(text)) {
+
+}
+
+} // namespace log
+
 } // namespace uuid
 
+static unsigned long test_micros = 0;
+
+unsigned long micros() {
+	test_micros += 100;
+	return test_micros;
+}
+
+static std::shared_ptr<uuid::log::Message> test_message(const std::string &text) {
+	return std::make_shared<uuid::log::Message>(0, uuid::log::Level::INFO, uuid::log::Facility::LPR, F("test"), std::move(text));
+}
+
 class TestShell;
 
 static std::shared_ptr<Commands> commands = std::make_shared<Commands>();
@@ -157,6 +241,72 @@ protected:
 	}
 };
 
+class PromptShell: public Shell {
+public:
+	PromptShell(Stream &stream, std::shared_ptr<Commands> commands)
+			: uuid::console::Shell(stream, std::move(commands)) {
+
+	}
+
+	std::string hostname_{"host"};
+	size_t calls_ = 0;
+
+protected:
+	std::string hostname_text() override {
+		calls_++;
+		return hostname_;
+	}
+
+	std::string context_text() override {
+		return context() ? std::string{"ctx"} : std::string{};
+	}
+};
+
+class NameTask: public Shell::Task {
+public:
+	Wait resume(Shell &shell, bool stop) override {
+		resumes_++;
+
+		if (stop) {
+			return Wait::done();
+		}
+
+		switch (state_) {
+		case 0:
+			shell.print("Name? ");
+			state_++;
+			return Wait::input();
+
+		case 1:
+			while (shell.available()) {
+				int c = shell.read();
+
+				if (c == '\r') {
+					state_++;
+					return Wait::delay_for(100);
+				}
+
+				name_ += c;
+			}
+			return Wait::input();
+
+		case 2:
+			state_++;
+			return Wait::output(16);
+
+		default:
+			shell.printfln("Hello %s", name_.c_str());
+			return Wait::done();
+		}
+	}
+
+	size_t resumes_ = 0;
+
+private:
+	int state_ = 0;
+	std::string name_;
+};
+
 /**
  * Test with CR line endings.
  */
@@ -1050,6 +1200,1456 @@ static void test_help() {
 	TEST_ASSERT_FALSE(shell->running());
 }
 
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+/**
+ * Test that the newest log messages are discarded when the lock-free queue is full.
+ */
+static void test_log_queue() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	// The maximum is rounded up to a power of 2
+	shell->maximum_log_messages(3);
+	TEST_ASSERT_EQUAL_INT(4, shell->maximum_log_messages());
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	for (int i = 0; i < 5; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   0: [test] message 0\r\n"
+			"   1: [test] message 1\r\n"
+			"   2: [test] message 2\r\n"
+			"   3: [test] message 3\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	// The maximum can't be changed after the shell has started
+	shell->maximum_log_messages(2);
+	TEST_ASSERT_EQUAL_INT(4, shell->maximum_log_messages());
+
+	// The queue can be reused after it wraps around
+	for (int i = 5; i < 12; i++) {
+		*shell << test_message("message " + std::to_string(i));
+
+		if (i % 2 == 0) {
+			shell->loop_one();
+		}
+	}
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   5: [test] message 5\r\n"
+			"   6: [test] message 6\r\n"
+			"$ "
+			"\033[G\033[K"
+			"   7: [test] message 7\r\n"
+			"   8: [test] message 8\r\n"
+			"$ "
+			"\033[G\033[K"
+			"   9: [test] message 9\r\n"
+			"   10: [test] message 10\r\n"
+			"$ "
+			"\033[G\033[K"
+			"   11: [test] message 11\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+# if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE > 1
+/**
+ * Test that log messages from multiple producers are all output once
+ * with increasing identifiers while the shell is running concurrently.
+ */
+static void test_log_queue_producers() {
+	static constexpr unsigned int PRODUCERS = 8;
+	static constexpr unsigned int MESSAGES = 5000;
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+	std::vector<std::thread> producers;
+	std::atomic<unsigned int> finished{0};
+	std::vector<std::vector<bool>> received(PRODUCERS, std::vector<bool>(MESSAGES));
+	unsigned long next_id = 0;
+	std::string pending;
+
+	// The queue never fills
+	shell->maximum_log_messages(PRODUCERS * MESSAGES);
+	shell->log_output_backpressure(true);
+	stream.available_for_write(INT_MAX);
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	for (unsigned int i = 0; i < PRODUCERS; i++) {
+		producers.emplace_back([&shell, &finished, i] {
+			for (unsigned int j = 0; j < MESSAGES; j++) {
+				*shell << test_message("producer " + std::to_string(i) + " message " + std::to_string(j));
+			}
+			finished++;
+		});
+	}
+
+	while (next_id < PRODUCERS * MESSAGES) {
+		bool done = finished == PRODUCERS;
+		unsigned long previous_id = next_id;
+
+		shell->loop_one();
+		pending += stream.output();
+
+		size_t end;
+
+		while ((end = pending.find("\r\n")) != std::string::npos) {
+			std::string line = pending.substr(0, end);
+			size_t start = line.find_first_of("0123456789");
+			unsigned long id;
+			unsigned int producer, message;
+
+			pending.erase(0, end + 2);
+			TEST_ASSERT_EQUAL_INT(std::string::npos, line.find("dropped"));
+
+			if (start == std::string::npos
+					|| std::sscanf(line.c_str() + start, "%lu: [test] producer %u message %u", &id, &producer, &message) != 3) {
+				continue;
+			}
+
+			TEST_ASSERT_EQUAL_INT(next_id, id);
+			TEST_ASSERT_TRUE(producer < PRODUCERS);
+			TEST_ASSERT_TRUE(message < MESSAGES);
+			TEST_ASSERT_FALSE(received[producer][message]);
+			received[producer][message] = true;
+			next_id++;
+		}
+
+		if (done && next_id == previous_id) {
+			// All of the messages that were queued have been output
+			break;
+		}
+	}
+
+	for (auto &producer : producers) {
+		producer.join();
+	}
+
+	TEST_ASSERT_EQUAL_INT(PRODUCERS * MESSAGES, next_id);
+
+#  if UUID_CONSOLE_STATISTICS
+	TEST_ASSERT_EQUAL_INT(0, shell->statistics().log_messages_dropped);
+	TEST_ASSERT_EQUAL_INT(PRODUCERS * MESSAGES, shell->statistics().log_messages_output);
+#  endif
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+# endif
+#else
+/**
+ * Test that the oldest log messages are discarded when the queue is full.
+ */
+static void test_log_queue() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	shell->maximum_log_messages(3);
+	TEST_ASSERT_EQUAL_INT(3, shell->maximum_log_messages());
+
+	for (int i = 0; i < 5; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   2: [test] message 2\r\n"
+			"   3: [test] message 3\r\n"
+			"   4: [test] message 4\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	// Reducing the size of the queue keeps the newest messages
+	for (int i = 5; i < 9; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+	shell->maximum_log_messages(2);
+	TEST_ASSERT_EQUAL_INT(2, shell->maximum_log_messages());
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   7: [test] message 7\r\n"
+			"   8: [test] message 8\r\n"
+			"$ ", stream.output().c_str());
+
+	// Increasing the size of the queue keeps all of the messages
+	for (int i = 9; i < 11; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+	shell->maximum_log_messages(0);
+	TEST_ASSERT_EQUAL_INT(1, shell->maximum_log_messages());
+	shell->maximum_log_messages(4);
+	*shell << test_message("message 11");
+	*shell << test_message("message 12");
+
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   10: [test] message 10\r\n"
+			"   11: [test] message 11\r\n"
+			"   12: [test] message 12\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+#endif
+
+/**
+ * Test that log messages are output correctly by multiple shells.
+ */
+static void test_log_multiple_shells() {
+	TestStream stream1{true};
+	TestStream stream2{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+
+	shell1->start();
+	shell2->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("$ ", stream2.output().c_str());
+
+	*shell2 << test_message("message A");
+	for (int i = 0; i < 3; i++) {
+		auto message = test_message("message " + std::to_string(i));
+
+		*shell1 << message;
+		*shell2 << message;
+	}
+
+	shell1->loop_one();
+	shell2->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   0: [test] message 0\r\n"
+			"   1: [test] message 1\r\n"
+			"   2: [test] message 2\r\n"
+			"$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   0: [test] message A\r\n"
+			"   1: [test] message 0\r\n"
+			"   2: [test] message 1\r\n"
+			"   3: [test] message 2\r\n"
+			"$ ", stream2.output().c_str());
+
+	shell1->stop();
+	shell2->stop();
+	TEST_ASSERT_FALSE(shell1->running());
+	TEST_ASSERT_FALSE(shell2->running());
+}
+
+/**
+ * Test that the output of log messages in each loop is limited.
+ */
+static void test_log_output_limits() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->maximum_log_messages(16);
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(Shell::MAX_LOG_MESSAGES, shell->maximum_log_output_messages());
+	TEST_ASSERT_EQUAL_INT(0, shell->maximum_log_output_bytes());
+	TEST_ASSERT_EQUAL_INT(0, shell->maximum_log_output_time());
+
+	for (int i = 0; i < 8; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+
+	// Each message is 24 bytes
+	shell->maximum_log_output_messages(2);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   0: [test] message 0\r\n"
+			"   1: [test] message 1\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->maximum_log_output_messages(0);
+	TEST_ASSERT_EQUAL_INT(1, shell->maximum_log_output_messages());
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   2: [test] message 2\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->maximum_log_output_messages(100);
+	shell->maximum_log_output_bytes(48);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   3: [test] message 3\r\n"
+			"   4: [test] message 4\r\n"
+			"$ ", stream.output().c_str());
+
+	// The time increases by 100µs every time it is read
+	shell->maximum_log_output_bytes(0);
+	shell->maximum_log_output_time(150);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   5: [test] message 5\r\n"
+			"   6: [test] message 6\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->maximum_log_output_time(0);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   7: [test] message 7\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+/**
+ * Test that input is processed in batches up to the end of a line.
+ */
+static void test_input_batch() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->maximum_input_batch(100);
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	stream << "noop\rhelp\r";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("help\r", stream.input().c_str());
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream.output().c_str());
+
+	shell->maximum_input_batch(2);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("lp\r", stream.input().c_str());
+	TEST_ASSERT_EQUAL_STRING("he", stream.output().c_str());
+
+	shell->maximum_input_batch(0);
+	TEST_ASSERT_EQUAL_INT(1, shell->maximum_input_batch());
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("p\r", stream.input().c_str());
+	TEST_ASSERT_EQUAL_STRING("l", stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+/**
+ * Test that the cached completion is cleared when the flags change.
+ */
+static void test_completion_cache() {
+	TestStream stream{true};
+	auto cache_commands = std::make_shared<Commands>();
+	auto shell = std::make_shared<Shell>(stream, cache_commands);
+	unsigned int calls = 0;
+
+	cache_commands->add_command(0, 1, flash_string_vector{F("secret")}, flash_string_vector{F("<value>")},
+		[] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {},
+		[&] (Shell &shell __attribute__((unused)), const std::vector<std::string> &current_arguments __attribute__((unused)),
+				const std::string &next_argument __attribute__((unused))) -> std::vector<std::string> {
+			calls++;
+			return {"value1", "value2"};
+		});
+
+	TEST_ASSERT_FALSE(shell->completion_cache());
+	shell->completion_cache(true);
+	TEST_ASSERT_TRUE(shell->completion_cache());
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	stream << "se\t";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("se", stream.output().c_str());
+
+	shell->add_flags(1);
+	stream << "\t";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("\x1B[G\x1B[K$ secret ", stream.output().c_str());
+
+	stream << "v\tv\t";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_INT(1, calls);
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+/**
+ * Test that the maximum command line length is limited by the line
+ * buffer and that completions which are too long are not used.
+ */
+static void test_maximum_command_line_length() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+#if UUID_CONSOLE_LINE_BUFFER_SIZE
+	TEST_ASSERT_EQUAL_INT(std::min(Shell::MAX_COMMAND_LINE_LENGTH, (size_t)UUID_CONSOLE_LINE_BUFFER_SIZE), shell->maximum_command_line_length());
+#else
+	TEST_ASSERT_EQUAL_INT(Shell::MAX_COMMAND_LINE_LENGTH, shell->maximum_command_line_length());
+#endif
+
+	shell->maximum_command_line_length(20);
+	TEST_ASSERT_EQUAL_INT(20, shell->maximum_command_line_length());
+
+	stream << "comm\t";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("comm", stream.output().c_str());
+
+	stream << "\x15" "tes\t";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("\033[G\033[K$ tes\033[G\033[K$ test", stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+/**
+ * Test that only shells that are ready are executed.
+ */
+static void test_loop_all_ready() {
+	TestStream stream1{true};
+	TestStream stream2{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+
+	shell1->start();
+	shell2->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("$ ", stream2.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+	TEST_ASSERT_EQUAL_INT(0, stream1.reads());
+	TEST_ASSERT_EQUAL_INT(0, stream2.reads());
+
+	stream1 << "noop\r";
+	while (!stream1.empty()) {
+		TEST_ASSERT_EQUAL_INT(0, Shell::loop_all_ready());
+	}
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_INT(0, stream2.reads());
+
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+
+	shell2->idle_timeout(10);
+	unsigned long wait = Shell::loop_all_ready();
+	TEST_ASSERT_LESS_OR_EQUAL(10000, wait);
+	TEST_ASSERT_LESS_OR_EQUAL(wait, 9900);
+
+	bool delayed = false;
+	shell1->delay_for(50, [&] (Shell &shell __attribute__((unused))) { delayed = true; });
+	wait = Shell::loop_all_ready();
+	TEST_ASSERT_LESS_OR_EQUAL(50, wait);
+	TEST_ASSERT_FALSE(delayed);
+
+	while (!delayed) {
+		TEST_ASSERT_LESS_OR_EQUAL(50, Shell::loop_all_ready());
+	}
+	TEST_ASSERT_EQUAL_STRING("$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_INT(0, stream2.reads());
+
+	shell1->stop();
+	shell2->stop();
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+}
+
+/**
+ * Test that shell timers expire in order and idle timeouts are
+ * rescheduled after input.
+ */
+static void test_loop_all_ready_timers() {
+	TestStream stream1{true};
+	TestStream stream2{true};
+	TestStream stream3{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+	auto shell3 = std::make_shared<Shell>(stream3, commands);
+	std::vector<int> order;
+
+	shell1->start();
+	shell2->start();
+	shell3->start();
+
+	shell1->delay_for(30, [&] (Shell &shell __attribute__((unused))) { order.push_back(1); });
+	shell2->delay_for(10, [&] (Shell &shell __attribute__((unused))) { order.push_back(2); });
+	shell3->delay_for(20, [&] (Shell &shell __attribute__((unused))) { order.push_back(3); });
+
+	TEST_ASSERT_LESS_OR_EQUAL(10, Shell::loop_all_ready());
+
+	while (order.size() < 3) {
+		Shell::loop_all_ready();
+	}
+	TEST_ASSERT_EQUAL_INT(2, order[0]);
+	TEST_ASSERT_EQUAL_INT(3, order[1]);
+	TEST_ASSERT_EQUAL_INT(1, order[2]);
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+
+	shell1->idle_timeout(1);
+	for (int i = 0; i < 500; i++) {
+		Shell::loop_all_ready();
+	}
+
+	stream1 << "noop\r";
+	while (!stream1.empty()) {
+		Shell::loop_all_ready();
+	}
+
+	uint64_t input_time = uuid::get_uptime_ms();
+	while (shell1->running()) {
+		Shell::loop_all_ready();
+	}
+	TEST_ASSERT_LESS_OR_EQUAL(uuid::get_uptime_ms() - input_time, 1000);
+
+	shell2->stop();
+	shell3->stop();
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+}
+
+/**
+ * Test reading multiple bytes in a blocking function.
+ */
+static void test_blocking_read_bytes(bool stream_supports_peek) {
+	TestStream stream{stream_supports_peek};
+	auto shell = std::make_shared<Shell>(stream, commands);
+	std::string data;
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	uint8_t unused;
+	TEST_ASSERT_EQUAL_INT(0, shell->read_bytes(&unused, sizeof(unused)));
+
+	test_fn = [&] (Shell &shell, bool stop) -> bool {
+		uint8_t buffer[8];
+		size_t length = shell.read_bytes(buffer, sizeof(buffer));
+
+		TEST_ASSERT_LESS_OR_EQUAL(sizeof(buffer), length);
+		data.append(reinterpret_cast<const char *>(buffer), length);
+		return stop || data.length() >= 14;
+	};
+
+	// The first LF following a CR is consumed
+	stream << "test\r\n0123456789\rABC\n";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	// The blocking function has finished
+	TEST_ASSERT_EQUAL_STRING("test\r\n$ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("0123456789\rABC\n", data.c_str());
+	TEST_ASSERT_EQUAL_INT(2, stream.bulk_reads());
+
+	// Only the first LF after the CR is consumed
+	data.clear();
+	stream << "test\r\n\n0123456789ABC\r";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("test\r\n$ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("\n0123456789ABC\r", data.c_str());
+	TEST_ASSERT_EQUAL_INT(4, stream.bulk_reads());
+
+	shell->stop();
+}
+
+static void test_blocking_read_bytes_peek() {
+	test_blocking_read_bytes(true);
+}
+
+static void test_blocking_read_bytes_no_peek() {
+	test_blocking_read_bytes(false);
+}
+
+/**
+ * Test producing output in chunks.
+ */
+static void test_output_with() {
+	TestStream stream1{true};
+	TestStream stream2{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+	Shell::Group group;
+	size_t position = 0;
+	std::vector<size_t> chunks;
+
+	shell1->start(group);
+	shell2->start(group);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("$ ", stream2.output().c_str());
+
+	shell1->output_with([&] (Shell &shell, size_t available) -> bool {
+		static const char data[] = "0123456789ABCDEFGHIJ\r\n";
+		size_t length = std::min(available, sizeof(data) - 1 - position);
+
+		chunks.push_back(available);
+		position += shell.write(reinterpret_cast<const uint8_t *>(&data[position]), length);
+		return position == sizeof(data) - 1;
+	});
+
+	// Nothing is output until the stream has space available
+	group.loop_all();
+	TEST_ASSERT_EQUAL_INT(0, chunks.size());
+
+	stream1.available_for_write(8);
+	stream2 << "noop\r";
+	group.loop_all();
+	TEST_ASSERT_EQUAL_STRING("01234567", stream1.output().c_str());
+
+	// Other shells continue to be executed
+	while (!stream2.empty()) {
+		stream1.available_for_write(8);
+		group.loop_all();
+	}
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream2.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("89ABCDEFGHIJ\r\n$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_INT(3, chunks.size());
+	TEST_ASSERT_EQUAL_INT(8, chunks[0]);
+	TEST_ASSERT_EQUAL_INT(8, chunks[1]);
+	TEST_ASSERT_EQUAL_INT(8, chunks[2]);
+
+	// Buffered output is excluded from the space available
+	shell1->output_buffer_size(16);
+	stream1.available_for_write(8);
+	shell1->print("xyz");
+	TEST_ASSERT_EQUAL_INT(5, shell1->availableForWrite());
+	shell1->flush();
+	TEST_ASSERT_EQUAL_STRING("xyz", stream1.output().c_str());
+
+	// Output is abandoned if the shell is stopped
+	position = 0;
+	shell1->output_with([&] (Shell &shell __attribute__((unused)), size_t available __attribute__((unused))) -> bool {
+		position++;
+		return false;
+	});
+	group.loop_all();
+	TEST_ASSERT_EQUAL_INT(1, position);
+	shell1->stop();
+	group.loop_all();
+	TEST_ASSERT_EQUAL_INT(1, position);
+	TEST_ASSERT_FALSE(shell1->running());
+
+	shell2->stop();
+}
+
+/**
+ * Shells can output log messages from a shared queue, with their own
+ * position in the queue.
+ */
+static void test_shared_log_queue() {
+	auto queue = std::make_shared<Shell::SharedLogQueue>(3);
+	TestStream stream1{true};
+	TestStream stream2{true};
+	TestStream stream3{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+	auto shell3 = std::make_shared<Shell>(stream3, commands);
+	Shell::Group group;
+
+	TEST_ASSERT_EQUAL_INT(3, queue->capacity());
+	TEST_ASSERT_NULL(shell1->shared_log_queue().get());
+
+	// Messages before the queue is used are not output
+	*queue << test_message("message 0");
+
+	shell1->shared_log_queue(queue);
+	shell2->shared_log_queue(queue);
+	TEST_ASSERT_EQUAL_PTR(queue.get(), shell1->shared_log_queue().get());
+	TEST_ASSERT_EQUAL_INT(1, shell1->maximum_log_messages());
+	shell1->start(group);
+	shell2->start(group);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("$ ", stream2.output().c_str());
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+
+	*queue << test_message("message 1");
+	*queue << test_message("message 2");
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   1: [test] message 1\r\n"
+			"   2: [test] message 2\r\n"
+			"$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   1: [test] message 1\r\n"
+			"   2: [test] message 2\r\n"
+			"$ ", stream2.output().c_str());
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+
+	// Each shell continues from its own position
+	*queue << test_message("message 3");
+	shell1->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   3: [test] message 3\r\n"
+			"$ ", stream1.output().c_str());
+
+	*queue << test_message("message 4");
+	*queue << test_message("message 5");
+	*queue << test_message("message 6");
+	shell1->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   4: [test] message 4\r\n"
+			"   5: [test] message 5\r\n"
+			"   6: [test] message 6\r\n"
+			"$ ", stream1.output().c_str());
+
+	// Messages that have been discarded are skipped
+	shell2->log_output_backpressure(true);
+	stream2.available_for_write(1000);
+	shell2->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"1 log messages dropped\r\n"
+			"   4: [test] message 4\r\n"
+			"   5: [test] message 5\r\n"
+			"   6: [test] message 6\r\n"
+			"$ ", stream2.output().c_str());
+
+	// Shells started later only output new messages
+	shell3->shared_log_queue(queue);
+	shell3->start(group);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream3.output().c_str());
+	*queue << test_message("message 7");
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   7: [test] message 7\r\n"
+			"$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   7: [test] message 7\r\n"
+			"$ ", stream2.output().c_str());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   7: [test] message 7\r\n"
+			"$ ", stream3.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+
+	// The queue can't be changed after the shell has started
+	shell1->shared_log_queue(nullptr);
+	TEST_ASSERT_EQUAL_PTR(queue.get(), shell1->shared_log_queue().get());
+	TEST_ASSERT_EQUAL_INT(1, shell1->maximum_log_messages());
+
+	auto shell4 = std::make_shared<Shell>(stream3, commands);
+	shell4->shared_log_queue(queue);
+	shell4->shared_log_queue(nullptr);
+	TEST_ASSERT_NULL(shell4->shared_log_queue().get());
+	TEST_ASSERT_TRUE(shell4->maximum_log_messages() >= Shell::MAX_LOG_MESSAGES);
+
+	shell1->stop();
+	shell2->stop();
+	shell3->stop();
+	group.loop_all();
+}
+
+/**
+ * Test that log messages wait for space to be available on the stream.
+ */
+static void test_log_output_backpressure() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+	Shell::Group group;
+
+	shell->maximum_log_messages(4);
+	TEST_ASSERT_FALSE(shell->log_output_backpressure());
+	shell->log_output_backpressure(true);
+	TEST_ASSERT_TRUE(shell->log_output_backpressure());
+	shell->start(group);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	// The stream starts empty
+	*shell << test_message("message 0");
+	stream.available_for_write(1000);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   0: [test] message 0\r\n"
+			"$ ", stream.output().c_str());
+
+	// The message and the prompt need 32 bytes
+	*shell << test_message("message 1");
+	stream.available_for_write(31);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	// The deferred message doesn't make the shell ready, but it is
+	// checked again soon
+	unsigned long wait = group.loop_all_ready();
+	TEST_ASSERT_TRUE(wait > 0);
+	TEST_ASSERT_LESS_OR_EQUAL(10, wait);
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	stream.available_for_write(32);
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   1: [test] message 1\r\n"
+			"$ ", stream.output().c_str());
+
+	// The next check is still scheduled but there's nothing to do
+	for (int i = 0; i < 20 && wait != ULONG_MAX; i++) {
+		wait = group.loop_all_ready();
+	}
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, wait);
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	// Output stops when there is no more space
+	*shell << test_message("message 2");
+	*shell << test_message("message 3");
+	stream.available_for_write(33);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   2: [test] message 2\r\n"
+			"$ ", stream.output().c_str());
+
+	// Messages that are discarded while waiting are reported
+	stream.available_for_write(0);
+	for (int i = 4; i < 11; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	stream.available_for_write(1000);
+	shell->loop_one();
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   3: [test] message 3\r\n"
+			"   4: [test] message 4\r\n"
+			"   5: [test] message 5\r\n"
+			"   6: [test] message 6\r\n"
+			"   7: [test] message 7\r\n"
+			"$ ", stream.output().c_str());
+
+	*shell << test_message("message 11");
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"3 log messages dropped\r\n"
+			"   11: [test] message 11\r\n"
+			"$ ", stream.output().c_str());
+#else
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   3: [test] message 3\r\n"
+			"3 log messages dropped\r\n"
+			"   7: [test] message 7\r\n"
+			"   8: [test] message 8\r\n"
+			"   9: [test] message 9\r\n"
+			"   10: [test] message 10\r\n"
+			"$ ", stream.output().c_str());
+#endif
+
+	shell->stop();
+	group.loop_all();
+}
+
+/**
+ * Test that a log message larger than the capacity of the stream is
+ * output when the stream is empty.
+ */
+static void test_log_output_backpressure_capacity() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+	Shell::Group group;
+
+	shell->log_output_backpressure(true);
+	shell->start(group);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	// The message and the prompt need 32 bytes
+	*shell << test_message("message 0");
+	stream.available_for_write(16);
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   0: [test] message 0\r\n"
+			"$ ", stream.output().c_str());
+
+	*shell << test_message("message 1");
+	stream.available_for_write(15);
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+	TEST_ASSERT_TRUE(group.loop_all_ready() > 0);
+
+	stream.available_for_write(16);
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   1: [test] message 1\r\n"
+			"$ ", stream.output().c_str());
+
+	shell->stop();
+	group.loop_all();
+}
+
+/**
+ * Test that a task is only resumed when the condition it is waiting for
+ * has been met.
+ */
+static void test_run_task() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+	std::unique_ptr<NameTask> task{new NameTask};
+	auto &name_task = *task;
+	Shell::Group group;
+
+	shell->start(group);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	shell->run_task(std::move(task));
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING("Name? ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(1, name_task.resumes_);
+
+	// Waiting for input
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+	group.loop_all();
+	TEST_ASSERT_EQUAL_INT(1, name_task.resumes_);
+
+	stream << "ab";
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_INT(2, name_task.resumes_);
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+
+	// Waiting for a delay
+	stream << "c\r";
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_INT(3, name_task.resumes_);
+	unsigned long wait = group.loop_all_ready();
+	TEST_ASSERT_LESS_OR_EQUAL(100, wait);
+	TEST_ASSERT_LESS_OR_EQUAL(wait, 90);
+	TEST_ASSERT_EQUAL_INT(3, name_task.resumes_);
+
+	while (name_task.resumes_ == 3) {
+		group.loop_all_ready();
+	}
+
+	// Waiting for space to output
+	TEST_ASSERT_EQUAL_INT(4, name_task.resumes_);
+	group.loop_all();
+	TEST_ASSERT_EQUAL_INT(4, name_task.resumes_);
+	stream.available_for_write(15);
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+	stream.available_for_write(16);
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING("Hello abc\r\n$ ", stream.output().c_str());
+
+	// A stop is handled immediately
+	task.reset(new NameTask);
+	auto &stop_task = *task;
+	shell->run_task(std::move(task));
+	group.loop_all_ready();
+	TEST_ASSERT_EQUAL_INT(1, stop_task.resumes_);
+	shell->stop();
+	TEST_ASSERT_TRUE(shell->running());
+	// The task has been destroyed
+	group.loop_all_ready();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+#if UUID_CONSOLE_STATISTICS
+/**
+ * Test that statistics are recorded for the shell and its commands.
+ */
+static void test_statistics() {
+	TestStream stream{true};
+	auto commands = std::make_shared<Commands>();
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	commands->add_command(flash_string_vector{F("noop")},
+			[] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+
+	});
+	commands->add_command(flash_string_vector{F("other")},
+			[] (Shell &shell __attribute__((unused)), const std::vector<std::string> &arguments __attribute__((unused))) {
+
+	});
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(2, shell->statistics().bytes_written);
+
+	shell->reset_statistics();
+	TEST_ASSERT_EQUAL_INT(0, shell->statistics().bytes_written);
+
+	// The time increases by 100µs every time it is read
+	stream << "noop\r";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream.output().c_str());
+
+	auto statistics = shell->statistics();
+	TEST_ASSERT_EQUAL_INT(8, statistics.bytes_written);
+	TEST_ASSERT_EQUAL_INT(100, statistics.find_command_time);
+	TEST_ASSERT_EQUAL_INT(0, statistics.complete_command_time);
+
+	for (auto &available_command : commands->available_commands(*shell)) {
+		if (available_command.name() == std::vector<std::string>{"noop"}) {
+			TEST_ASSERT_EQUAL_INT(1, available_command.executions());
+			TEST_ASSERT_EQUAL_INT(100, available_command.execution_time());
+		} else {
+			TEST_ASSERT_EQUAL_INT(0, available_command.executions());
+		}
+	}
+
+	stream << "no\t";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_INT(100, shell->statistics().complete_command_time);
+
+	shell->maximum_log_messages(4);
+	for (int i = 0; i < 3; i++) {
+		*shell << test_message("message " + std::to_string(i));
+	}
+	statistics = shell->statistics();
+	TEST_ASSERT_EQUAL_INT(3, statistics.log_messages_queued);
+	TEST_ASSERT_EQUAL_INT(0, statistics.log_messages_output);
+
+	shell->maximum_log_output_messages(2);
+	shell->loop_one();
+	statistics = shell->statistics();
+	TEST_ASSERT_EQUAL_INT(3, statistics.log_messages_queued);
+	TEST_ASSERT_EQUAL_INT(2, statistics.log_messages_output);
+	TEST_ASSERT_EQUAL_INT(0, statistics.log_messages_dropped);
+	TEST_ASSERT_EQUAL_INT(3, statistics.log_messages_maximum);
+
+	stream.output();
+	shell->print_statistics();
+	std::string output = stream.output();
+	TEST_ASSERT_EQUAL_STRING(
+		"Bytes written: ", output.substr(0, 15).c_str());
+	TEST_ASSERT_TRUE(output.find("\r\nLog messages: 3 queued, 2 output, 0 dropped, 3 maximum queued\r\n") != std::string::npos);
+	TEST_ASSERT_TRUE(output.find("\r\nnoop: 1 executions, 100 us\r\nother: 0 executions, 0 us\r\n") != std::string::npos);
+
+	shell->stop();
+}
+#endif
+
+/**
+ * Test that log messages are inserted above the command line when the
+ * width of the terminal is known.
+ */
+static void test_log_insert_above() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	TEST_ASSERT_EQUAL_INT(0, shell->terminal_width());
+	shell->terminal_width(80);
+	TEST_ASSERT_EQUAL_INT(80, shell->terminal_width());
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	stream << "abc";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("abc", stream.output().c_str());
+
+	// Each message is 22 columns wide
+	*shell << test_message("message 0");
+	*shell << test_message("message 1");
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033D\033[1A\033" "7\033[1L"
+			"   0: [test] message 0\r\n"
+			"\033" "8\033[1B"
+			"\033D\033[1A\033" "7\033[1L"
+			"   1: [test] message 1\r\n"
+			"\033" "8\033[1B", stream.output().c_str());
+
+	// Messages that are longer than the width use more than one line
+	shell->terminal_width(11);
+	*shell << test_message("message 2");
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033D\033D\033[2A\033" "7\033[2L"
+			"   2: [test] message 2\r\n"
+			"\033" "8\033[2B", stream.output().c_str());
+
+	// The command line is output again if it doesn't fit on one line
+	shell->terminal_width(5);
+	*shell << test_message("message 3");
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   3: [test] message 3\r\n"
+			"$ abc", stream.output().c_str());
+
+	shell->terminal_width(0);
+	*shell << test_message("message 4");
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033[G\033[K"
+			"   4: [test] message 4\r\n"
+			"$ abc", stream.output().c_str());
+
+	shell->stop();
+}
+
+/**
+ * Test that log messages inserted above the command line wait for space
+ * to output the terminal control sequences.
+ */
+static void test_log_insert_above_backpressure() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->terminal_width(80);
+	shell->log_output_backpressure(true);
+	stream.available_for_write(1000);
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	stream << "abc";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("abc", stream.output().c_str());
+
+	*shell << test_message("message 0");
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033D\033[1A\033" "7\033[1L"
+			"   0: [test] message 0\r\n"
+			"\033" "8\033[1B", stream.output().c_str());
+
+	// The message and the control sequences need 42 bytes
+	*shell << test_message("message 1");
+	stream.available_for_write(41);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	stream.available_for_write(42);
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING(
+			"\033D\033[1A\033" "7\033[1L"
+			"   1: [test] message 1\r\n"
+			"\033" "8\033[1B", stream.output().c_str());
+
+	shell->stop();
+}
+
+/**
+ * Test that the text of the command prompt is created every time it is
+ * displayed unless it is cached.
+ */
+static void test_prompt_cache() {
+	TestStream stream{true};
+	auto shell = std::make_shared<PromptShell>(stream, commands);
+
+	TEST_ASSERT_FALSE(shell->prompt_cache());
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("host $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(1, shell->calls_);
+
+	stream << "\r\r";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("\r\nhost $ \r\nhost $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(3, shell->calls_);
+
+	shell->prompt_cache(true);
+	TEST_ASSERT_TRUE(shell->prompt_cache());
+	stream << "\r\rnoop\r";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("\r\nhost $ \r\nhost $ noop\r\nhost $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(4, shell->calls_);
+
+	// The cached prompt is used until it is invalidated
+	shell->hostname_ = "other";
+	stream << "\r";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("\r\nhost $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(4, shell->calls_);
+
+	shell->invalidate_prompt();
+	stream << "\r\r";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("\r\nother $ \r\nother $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(5, shell->calls_);
+
+	// Changes to the context or flags invalidate the cache
+	shell->enter_context(1);
+	stream << "\r";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("\r\nother ctx $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(6, shell->calls_);
+
+	shell->exit_context();
+	stream << "\r";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("\r\nother $ ", stream.output().c_str());
+	TEST_ASSERT_EQUAL_INT(7, shell->calls_);
+
+	shell->add_flags(1);
+	stream << "\r";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_INT(8, shell->calls_);
+
+	shell->remove_flags(1);
+	stream << "\r\r";
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_INT(9, shell->calls_);
+
+	shell->prompt_cache(false);
+	stream << "\r";
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_INT(10, shell->calls_);
+
+	shell->stop();
+}
+
+/**
+ * Test that shells in different groups are only executed by their own
+ * group.
+ */
+static void test_shell_groups() {
+	TestStream stream1{true};
+	TestStream stream2{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+	std::weak_ptr<Shell> weak1 = shell1;
+	Shell::Group group1;
+	Shell::Group group2;
+
+	shell1->start(group1);
+	shell2->start(group2);
+	TEST_ASSERT_EQUAL_STRING("$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_STRING("$ ", stream2.output().c_str());
+
+	stream1 << "noop\r";
+	stream2 << "noop\r";
+	Shell::loop_all();
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+	TEST_ASSERT_EQUAL_INT(0, stream1.reads());
+	TEST_ASSERT_EQUAL_INT(0, stream2.reads());
+
+	while (!stream1.empty()) {
+		group1.loop_all();
+	}
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream1.output().c_str());
+	TEST_ASSERT_EQUAL_INT(0, stream2.reads());
+
+	while (!stream2.empty()) {
+		TEST_ASSERT_EQUAL_INT(0, group2.loop_all_ready());
+	}
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream2.output().c_str());
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group2.loop_all_ready());
+
+	// Each group has its own timers
+	bool delayed = false;
+	shell2->delay_for(50, [&] (Shell &shell __attribute__((unused))) { delayed = true; });
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group1.loop_all_ready());
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, Shell::loop_all_ready());
+	TEST_ASSERT_LESS_OR_EQUAL(50, group2.loop_all_ready());
+
+	while (!delayed) {
+		group2.loop_all_ready();
+	}
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group2.loop_all_ready());
+
+	// Stopped shells are removed from their group
+	shell1->stop();
+	shell1.reset();
+	TEST_ASSERT_FALSE(weak1.expired());
+	group1.loop_all();
+	TEST_ASSERT_TRUE(weak1.expired());
+
+	// Shells that are still registered are released with their group
+	shell2->delay_for(50, [&] (Shell &shell __attribute__((unused))) { delayed = false; });
+	TEST_ASSERT_LESS_OR_EQUAL(50, group2.loop_all_ready());
+}
+
+/**
+ * Test that a shell started by a command in the same group is
+ * executed by the next loop through the group.
+ */
+static void test_shell_groups_start_in_loop() {
+	TestStream stream1{true};
+	TestStream stream2{true};
+	auto shell1 = std::make_shared<Shell>(stream1, commands);
+	auto shell2 = std::make_shared<Shell>(stream2, commands);
+	Shell::Group group;
+
+	shell1->start(group);
+	shell1->delay_for(0, [&] (Shell &shell __attribute__((unused))) { shell2->start(group); });
+	TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	TEST_ASSERT_EQUAL_STRING("$ ", stream2.output().c_str());
+
+	stream2 << "noop\r";
+	while (!stream2.empty()) {
+		TEST_ASSERT_EQUAL_INT(0, group.loop_all_ready());
+	}
+	TEST_ASSERT_EQUAL_STRING("noop\r\n$ ", stream2.output().c_str());
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+
+	shell1->stop();
+	shell2->stop();
+	TEST_ASSERT_EQUAL_INT(ULONG_MAX, group.loop_all_ready());
+}
+
+/**
+ * Test that buffered output is kept when the stream doesn't accept all
+ * of it.
+ */
+static void test_output_buffer_partial_write() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->output_buffer_size(8);
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	shell->print("abcdef");
+	stream.write_limit(2);
+	shell->flush();
+	TEST_ASSERT_EQUAL_STRING("ab", stream.output().c_str());
+
+	// The buffer is full of output that hasn't been written yet
+	stream.write_limit(0);
+	TEST_ASSERT_EQUAL_INT(4, shell->print("ghijklmn"));
+	TEST_ASSERT_EQUAL_INT(0, shell->print("o"));
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	stream.write_limit(3);
+	TEST_ASSERT_EQUAL_INT(3, shell->print("pqrstu"));
+	TEST_ASSERT_EQUAL_STRING("cde", stream.output().c_str());
+
+	// Unwritten output is kept when the buffer size changes
+	stream.write_limit(1);
+	shell->output_buffer_size(16);
+	TEST_ASSERT_EQUAL_STRING("f", stream.output().c_str());
+	stream.write_limit(-1);
+	shell->flush();
+	TEST_ASSERT_EQUAL_STRING("ghijpqr", stream.output().c_str());
+
+	shell->stop();
+}
+
+/**
+ * Test that output is buffered until the end of the loop.
+ */
+static void test_output_buffer() {
+	TestStream stream{true};
+	size_t executions = 0;
+	auto shell = std::make_shared<Shell>(stream, commands);
+
+	shell->output_buffer_size(8);
+	TEST_ASSERT_EQUAL_INT(8, shell->output_buffer_size());
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	stream << "test\n";
+	test_fn = [executions, &stream] (Shell &shell, bool stop) mutable -> bool {
+		TEST_ASSERT_EQUAL(1, ++executions);
+
+		shell.print("abc");
+		TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+		shell.flush();
+		TEST_ASSERT_EQUAL_STRING("abc", stream.output().c_str());
+
+		shell.print("defghi");
+		shell.print("jk");
+		TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+		shell.print("l");
+		TEST_ASSERT_EQUAL_STRING("defghijk", stream.output().c_str());
+		shell.print("0123456789");
+		TEST_ASSERT_EQUAL_STRING("l0123456789", stream.output().c_str());
+		shell.print("lmn");
+		return true;
+	};
+
+	while (!stream.empty()) {
+		shell->loop_one();
+	}
+	TEST_ASSERT_EQUAL_STRING("test\r\n", stream.output().c_str());
+	shell->loop_one();
+	TEST_ASSERT_EQUAL_STRING("lmn$ ", stream.output().c_str());
+
+	shell->print("x");
+	shell->output_buffer_size(0);
+	TEST_ASSERT_EQUAL_STRING("x", stream.output().c_str());
+	shell->print("y");
+	TEST_ASSERT_EQUAL_STRING("y", stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
+/**
+ * Test formatted output of short and long messages.
+ */
+static void test_printf() {
+	TestStream stream{true};
+	auto shell = std::make_shared<Shell>(stream, commands);
+	std::string long_text(200, 'x');
+
+	shell->start();
+	TEST_ASSERT_EQUAL_STRING("$ ", stream.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(0, shell->printf("%s", ""));
+	TEST_ASSERT_EQUAL_STRING("", stream.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(7, shell->printf("%d %s", 42, "test"));
+	TEST_ASSERT_EQUAL_STRING("42 test", stream.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(203, shell->printf(F("%s %d"), long_text.c_str(), 42));
+	TEST_ASSERT_EQUAL_STRING((long_text + " 42").c_str(), stream.output().c_str());
+
+	TEST_ASSERT_EQUAL_INT(205, shell->printfln("%s%s", long_text.c_str(), "end"));
+	TEST_ASSERT_EQUAL_STRING((long_text + "end\r\n").c_str(), stream.output().c_str());
+
+	shell->stop();
+	TEST_ASSERT_FALSE(shell->running());
+}
+
 /**
  * Test end of transmission with no-op commands.
  */
@@ -1815,6 +3415,35 @@ int main(int argc, char *argv[]) {
 	RUN_TEST(test_blocking_stop);
 	RUN_TEST(test_no_stream);
 	RUN_TEST(test_help);
+	RUN_TEST(test_log_queue);
+#if UUID_CONSOLE_LOCK_FREE_LOG_QUEUE > 1
+	RUN_TEST(test_log_queue_producers);
+#endif
+	RUN_TEST(test_log_output_limits);
+	RUN_TEST(test_log_multiple_shells);
+	RUN_TEST(test_input_batch);
+	RUN_TEST(test_output_buffer);
+	RUN_TEST(test_output_buffer_partial_write);
+	RUN_TEST(test_completion_cache);
+	RUN_TEST(test_maximum_command_line_length);
+	RUN_TEST(test_loop_all_ready);
+	RUN_TEST(test_loop_all_ready_timers);
+	RUN_TEST(test_blocking_read_bytes_peek);
+	RUN_TEST(test_blocking_read_bytes_no_peek);
+	RUN_TEST(test_output_with);
+	RUN_TEST(test_log_output_backpressure);
+	RUN_TEST(test_log_output_backpressure_capacity);
+	RUN_TEST(test_shared_log_queue);
+	RUN_TEST(test_run_task);
+#if UUID_CONSOLE_STATISTICS
+	RUN_TEST(test_statistics);
+#endif
+	RUN_TEST(test_log_insert_above);
+	RUN_TEST(test_log_insert_above_backpressure);
+	RUN_TEST(test_prompt_cache);
+	RUN_TEST(test_shell_groups);
+	RUN_TEST(test_shell_groups_start_in_loop);
+	RUN_TEST(test_printf);
 	RUN_TEST(test_end_of_transmission1);
 	RUN_TEST(test_end_of_transmission2a);
 	RUN_TEST(test_end_of_transmission2b);